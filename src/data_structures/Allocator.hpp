@@ -0,0 +1,162 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+#include "Array.hpp"
+
+// allocation policies for the containers (Array, List, Map), following the std::allocator interface
+
+// bump allocator over a chain of blocks
+// memory is given back only by rewinding to a marker, the blocks are kept for reuse,
+// so a phase that is repeated many times (e.g. one vertex insertion) stops allocating
+class MonotonicArena
+{
+public:
+	struct Marker
+	{
+		size_t block;
+		size_t offset;
+	};
+private:
+	struct Block
+	{
+		char* data;
+		size_t size;
+	};
+	Array<Block> m_blocks;
+	size_t m_current = 0; // block being filled
+	size_t m_offset = 0; // first free byte of the current block
+	size_t m_initialBlockSize;
+public:
+	explicit MonotonicArena(size_t initialBlockSize = 64 * 1024);
+	~MonotonicArena();
+	MonotonicArena(const MonotonicArena&) = delete;
+	MonotonicArena(MonotonicArena&&) = delete;
+	MonotonicArena& operator=(const MonotonicArena&) = delete;
+	MonotonicArena& operator=(MonotonicArena&&) = delete;
+
+	void* allocate(size_t bytes, size_t alignment);
+	Marker mark() const;
+	void rewind(const Marker& marker); // everything allocated after the marker is released
+	void reset();
+	size_t capacity() const; // bytes held in all blocks
+private:
+	static Block newBlock(size_t size);
+	static size_t alignUp(const char* data, size_t offset, size_t alignment); // aligns the address data + offset
+};
+
+// releases everything allocated from the arena during its lifetime
+class ArenaScope
+{
+private:
+	MonotonicArena& m_arena;
+	MonotonicArena::Marker m_marker;
+public:
+	explicit ArenaScope(MonotonicArena& arena) : m_arena(arena), m_marker(arena.mark()) {}
+	~ArenaScope() { m_arena.rewind(m_marker); }
+	ArenaScope(const ArenaScope&) = delete;
+	ArenaScope(ArenaScope&&) = delete;
+	ArenaScope& operator=(const ArenaScope&) = delete;
+	ArenaScope& operator=(ArenaScope&&) = delete;
+};
+
+// allocator drawing from a MonotonicArena, deallocation is a no-op
+template <typename T>
+class ArenaAllocator
+{
+private:
+	MonotonicArena* m_arena;
+public:
+	using value_type = T;
+
+	explicit ArenaAllocator(MonotonicArena& arena) : m_arena(&arena) {}
+	template <typename U>
+	ArenaAllocator(const ArenaAllocator<U>& other) : m_arena(other.arena()) {}
+
+	T* allocate(size_t count) { return static_cast<T*>(m_arena->allocate(count * sizeof(T), alignof(T))); }
+	void deallocate(T*, size_t) {}
+	MonotonicArena* arena() const { return m_arena; }
+
+	template <typename U>
+	bool operator==(const ArenaAllocator<U>& other) const { return m_arena == other.arena(); }
+	template <typename U>
+	bool operator!=(const ArenaAllocator<U>& other) const { return m_arena != other.arena(); }
+};
+
+inline MonotonicArena::MonotonicArena(size_t initialBlockSize)
+	: m_blocks(0), m_initialBlockSize(initialBlockSize > 0 ? initialBlockSize : 1) {}
+
+inline MonotonicArena::~MonotonicArena()
+{
+	for (const Block& block : m_blocks)
+		::operator delete(block.data);
+}
+
+inline void* MonotonicArena::allocate(size_t bytes, size_t alignment)
+{
+	if (!m_blocks.empty())
+	{
+		size_t aligned = alignUp(m_blocks[m_current].data, m_offset, alignment);
+		if (aligned + bytes <= m_blocks[m_current].size)
+		{
+			m_offset = aligned + bytes;
+			return m_blocks[m_current].data + aligned;
+		}
+	}
+	// continue in the next block, replacing it when it is too small
+	size_t next = m_blocks.empty() ? 0 : m_current + 1;
+	size_t required = bytes + alignment;
+	if (next == m_blocks.size())
+	{
+		size_t size = m_blocks.empty() ? m_initialBlockSize : 2 * m_blocks.back().size;
+		m_blocks.pushBack(newBlock(std::max(size, required)));
+	}
+	else if (m_blocks[next].size < required)
+	{
+		size_t size = std::max(2 * m_blocks[next].size, required);
+		::operator delete(m_blocks[next].data);
+		m_blocks[next] = newBlock(size);
+	}
+	m_current = next;
+	size_t aligned = alignUp(m_blocks[m_current].data, 0, alignment);
+	m_offset = aligned + bytes;
+	return m_blocks[m_current].data + aligned;
+}
+
+inline MonotonicArena::Marker MonotonicArena::mark() const
+{
+	return { m_current, m_offset };
+}
+
+inline void MonotonicArena::rewind(const Marker& marker)
+{
+	m_current = marker.block;
+	m_offset = marker.offset;
+}
+
+inline void MonotonicArena::reset()
+{
+	rewind({ 0, 0 });
+}
+
+inline size_t MonotonicArena::capacity() const
+{
+	size_t bytes = 0;
+	for (const Block& block : m_blocks)
+		bytes += block.size;
+	return bytes;
+}
+
+inline MonotonicArena::Block MonotonicArena::newBlock(size_t size)
+{
+	// aligned for any fundamental type only, stricter alignments use the slack of required
+	return { static_cast<char*>(::operator new(size)), size };
+}
+
+inline size_t MonotonicArena::alignUp(const char* data, size_t offset, size_t alignment)
+{
+	uintptr_t address = reinterpret_cast<uintptr_t>(data) + offset;
+	return offset + (((address + alignment - 1) & ~(uintptr_t(alignment) - 1)) - address);
+}
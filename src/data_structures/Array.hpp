@@ -1,18 +1,26 @@
 #pragma once
 #include <algorithm>
+#include <memory>
+#include <new>
 #include <utility>
 #include <initializer_list>
 
-template <typename T>
+// contiguous growable array, elements live in uninitialised storage obtained from the
+// allocator and are constructed in place, growth moves each element exactly once
+template <typename T, typename Allocator = std::allocator<T>>
 class Array
 {
 protected:
+	using AllocatorTraits = std::allocator_traits<Allocator>;
 	size_t m_size;
 	size_t m_capacity;
 	T* m_items;
+	Allocator m_allocator;
 public:
-	explicit Array(size_t size = 0);
+	Array();
+	explicit Array(size_t size);
 	Array(size_t size, const T& t);
+	explicit Array(const Allocator& allocator);
 	Array(const Array& a);
 	Array(Array&& a) noexcept;
 	Array(std::initializer_list<T> initList);
@@ -57,277 +65,326 @@ public:
 	ConstIterator data() const;
 
 	static constexpr size_t SPARE_CAPACITY = 8;
+private:
+	void reallocate(size_t newCapacity); // moves the elements into new storage
+	void destroy(size_t from, size_t to);
+	void release();
 };
 
 
-template<typename T>
-inline Array<T>::Array(size_t size)
-	: m_size(size), m_capacity(size + SPARE_CAPACITY)
+template<typename T, typename Allocator>
+inline Array<T, Allocator>::Array()
+	: m_size(0), m_capacity(SPARE_CAPACITY), m_allocator()
 {
-	m_items = new T[m_capacity];
+	m_items = AllocatorTraits::allocate(m_allocator, m_capacity);
+}
+
+template<typename T, typename Allocator>
+inline Array<T, Allocator>::Array(size_t size)
+	: m_size(size), m_capacity(size + SPARE_CAPACITY), m_allocator()
+{
+	m_items = AllocatorTraits::allocate(m_allocator, m_capacity);
 	for (size_t i = 0; i < size; i++)
-		m_items[i] = T();
+		new (m_items + i) T();
 }
 
-template<typename T>
-inline Array<T>::Array(size_t size, const T& t) : m_size(size), m_capacity(size + SPARE_CAPACITY)
+template<typename T, typename Allocator>
+inline Array<T, Allocator>::Array(size_t size, const T& t)
+	: m_size(size), m_capacity(size + SPARE_CAPACITY), m_allocator()
 {
-	m_items = new T[m_capacity];
+	m_items = AllocatorTraits::allocate(m_allocator, m_capacity);
 	for (size_t i = 0; i < size; i++)
-		m_items[i] = T(t);
+		new (m_items + i) T(t);
 }
 
-template<typename T>
-inline Array<T>::Array(const Array& a)
-	: m_size(a.m_size), m_capacity(a.m_capacity), m_items(nullptr)
+template<typename T, typename Allocator>
+inline Array<T, Allocator>::Array(const Allocator& allocator)
+	: m_size(0), m_capacity(SPARE_CAPACITY), m_allocator(allocator)
 {
-	m_items = new T[m_capacity];
+	m_items = AllocatorTraits::allocate(m_allocator, m_capacity);
+}
+
+template<typename T, typename Allocator>
+inline Array<T, Allocator>::Array(const Array& a)
+	: m_size(a.m_size), m_capacity(a.m_capacity), m_items(nullptr),
+	  m_allocator(AllocatorTraits::select_on_container_copy_construction(a.m_allocator))
+{
+	m_items = AllocatorTraits::allocate(m_allocator, m_capacity);
 	for (size_t i = 0; i < m_size; ++i)
-		m_items[i] = a.m_items[i];
+		new (m_items + i) T(a.m_items[i]);
 }
 
-template<typename T>
-inline Array<T>::Array(Array<T>&& a) noexcept
-	: m_size(a.m_size), m_capacity(a.m_capacity), m_items(a.m_items)
+template<typename T, typename Allocator>
+inline Array<T, Allocator>::Array(Array&& a) noexcept
+	: m_size(a.m_size), m_capacity(a.m_capacity), m_items(a.m_items), m_allocator(a.m_allocator)
 {
 	a.m_items = nullptr;
 	a.m_size = 0;
 	a.m_capacity = 0;
 }
 
-template<typename T>
-inline Array<T>::Array(std::initializer_list<T> initList) :
-	m_size(initList.size()), m_capacity(initList.size() + SPARE_CAPACITY)
+template<typename T, typename Allocator>
+inline Array<T, Allocator>::Array(std::initializer_list<T> initList) :
+	m_size(initList.size()), m_capacity(initList.size() + SPARE_CAPACITY), m_allocator()
 {
-	m_items = new T[m_capacity];
+	m_items = AllocatorTraits::allocate(m_allocator, m_capacity);
 	size_t i = 0;
 	for (const T& item : initList)
 	{
-		m_items[i++] = item;
+		new (m_items + i++) T(item);
 	}
 }
 
-template<typename T>
-inline Array<T>::~Array()
+template<typename T, typename Allocator>
+inline Array<T, Allocator>::~Array()
 {
-	delete[] m_items;
+	release();
 }
 
-template<typename T>
-inline Array<T>& Array<T>::operator=(const Array<T>& a)
+template<typename T, typename Allocator>
+inline Array<T, Allocator>& Array<T, Allocator>::operator=(const Array& a)
 {
-	Array<T> copy(a);
-	std::swap(*this, copy);
+	Array copy(a);
+	swap(std::move(copy));
 	return *this;
 }
 
-template<typename T>
-inline Array<T>& Array<T>::operator=(Array<T>&& a) noexcept
+template<typename T, typename Allocator>
+inline Array<T, Allocator>& Array<T, Allocator>::operator=(Array&& a) noexcept
 {
 	if (this != &a)
-	{
-		std::swap(m_size, a.m_size);
-		std::swap(m_capacity, a.m_capacity);
-		std::swap(m_items, a.m_items);
-	}
+		swap(std::move(a));
 	return *this;
 }
 
-template<typename T>
-inline void Array<T>::resize(size_t newSize)
+template<typename T, typename Allocator>
+inline void Array<T, Allocator>::resize(size_t newSize)
 {
 	// if growing
 	if (newSize > m_size)
 	{
 		if (newSize > m_capacity)
-			reserve(newSize * 2);
+			reallocate(newSize * 2);
 		for (size_t i = m_size; i < newSize; ++i)
-			m_items[i] = T();
+			new (m_items + i) T();
 	}
+	else
+		destroy(newSize, m_size);
 	m_size = newSize;
 }
 
-template<typename T>
-inline void Array<T>::reserve(size_t newCapacity)
+template<typename T, typename Allocator>
+inline void Array<T, Allocator>::reserve(size_t newCapacity)
 {
 	if (newCapacity < m_size)
 		return;
-	T* newData = new T[newCapacity];
-	for (size_t i = 0; i < m_size; ++i)
-		newData[i] = std::move(m_items[i]);
-	// free old memory
-	delete[] m_items;
-	m_items = newData;
-	m_capacity = newCapacity;
+	reallocate(newCapacity);
 }
 
-template<typename T>
-inline T& Array<T>::operator[](size_t i)
+template<typename T, typename Allocator>
+inline T& Array<T, Allocator>::operator[](size_t i)
 {
 	return m_items[i];
 }
 
-template<typename T>
-inline const T& Array<T>::operator[](size_t i) const
+template<typename T, typename Allocator>
+inline const T& Array<T, Allocator>::operator[](size_t i) const
 {
 	return m_items[i];
 }
 
-template<typename T>
-inline bool Array<T>::empty() const
+template<typename T, typename Allocator>
+inline bool Array<T, Allocator>::empty() const
 {
 	return m_size == static_cast<size_t>(0);
 }
 
-template<typename T>
-inline size_t Array<T>::size() const
+template<typename T, typename Allocator>
+inline size_t Array<T, Allocator>::size() const
 {
 	return m_size;
 }
 
-template<typename T>
-inline size_t Array<T>::capacity() const
+template<typename T, typename Allocator>
+inline size_t Array<T, Allocator>::capacity() const
 {
 	return m_capacity;
 }
 
-template<typename T>
-inline void Array<T>::pushBack(const T& t)
+template<typename T, typename Allocator>
+inline void Array<T, Allocator>::pushBack(const T& t)
 {
 	if (m_size == m_capacity)
-		reserve(std::max(2 * m_capacity, static_cast<size_t>(1)));
-	m_items[m_size++] = t;
+	{
+		// t may refer to an element of this array
+		T copy(t);
+		reallocate(std::max(2 * m_capacity, static_cast<size_t>(1)));
+		new (m_items + m_size++) T(std::move(copy));
+		return;
+	}
+	new (m_items + m_size++) T(t);
 }
 
-template<typename T>
-inline void Array<T>::pushBack(T&& t)
+template<typename T, typename Allocator>
+inline void Array<T, Allocator>::pushBack(T&& t)
 {
 	if (m_size == m_capacity)
-		reserve(std::max(2 * m_capacity, size_t(1)));
-	m_items[m_size++] = std::move(t);
+	{
+		T moved(std::move(t));
+		reallocate(std::max(2 * m_capacity, size_t(1)));
+		new (m_items + m_size++) T(std::move(moved));
+		return;
+	}
+	new (m_items + m_size++) T(std::move(t));
 }
 
-template<typename T>
-inline void Array<T>::popBack()
+template<typename T, typename Allocator>
+inline void Array<T, Allocator>::popBack()
 {
 	if (m_size > 0)
 	{
 		--m_size;
+		m_items[m_size].~T();
 	}
 }
 
-template<typename T>
-inline const T& Array<T>::back() const
+template<typename T, typename Allocator>
+inline const T& Array<T, Allocator>::back() const
 {
 	return m_items[m_size - 1];
 }
 
-template<typename T>
-inline T& Array<T>::back()
+template<typename T, typename Allocator>
+inline T& Array<T, Allocator>::back()
 {
 	return m_items[m_size - 1];
 }
 
-template<typename T>
-inline const T& Array<T>::front() const
+template<typename T, typename Allocator>
+inline const T& Array<T, Allocator>::front() const
 {
 	return m_items[0];
 }
 
-template<typename T>
-inline T& Array<T>::front()
+template<typename T, typename Allocator>
+inline T& Array<T, Allocator>::front()
 {
 	return m_items[0];
 }
 
-template<typename T>
-inline void Array<T>::swap(Array&& other) noexcept
+template<typename T, typename Allocator>
+inline void Array<T, Allocator>::swap(Array&& other) noexcept
 {
 	using std::swap;
 	swap(m_size, other.m_size);
 	swap(m_capacity, other.m_capacity);
 	swap(m_items, other.m_items);
+	swap(m_allocator, other.m_allocator);
 }
 
-template<typename T>
-inline void Array<T>::shrinkToFit()
+template<typename T, typename Allocator>
+inline void Array<T, Allocator>::shrinkToFit()
 {
 	if (m_capacity == m_size)
 		return;
 	if (m_size == 0)
 	{
-		delete[] m_items;
+		release();
 		m_items = nullptr;
 		m_capacity = 0;
 		return;
 	}
-	T* newItems = new T[m_size];
-	for (size_t i = 0; i < m_size; i++)
-	{
-		newItems[i] = std::move(m_items[i]);
-	}
-	delete[] m_items;
-	m_items = newItems;
-	m_capacity = m_size;
+	reallocate(m_size);
 }
 
-template<typename T>
-inline void Array<T>::clear()
+template<typename T, typename Allocator>
+inline void Array<T, Allocator>::clear()
 {
+	destroy(0, m_size);
 	m_size = 0;
 }
 
-template<typename T>
-inline typename Array<T>::Iterator Array<T>::begin()
+template<typename T, typename Allocator>
+inline typename Array<T, Allocator>::Iterator Array<T, Allocator>::begin()
 {
 	return m_items;
 }
 
-template<typename T>
-inline typename Array<T>::ConstIterator Array<T>::begin() const
+template<typename T, typename Allocator>
+inline typename Array<T, Allocator>::ConstIterator Array<T, Allocator>::begin() const
 {
 	return m_items;
 }
 
-template<typename T>
-inline typename Array<T>::ConstIterator Array<T>::cbegin() const
+template<typename T, typename Allocator>
+inline typename Array<T, Allocator>::ConstIterator Array<T, Allocator>::cbegin() const
 {
 	return m_items;
 }
 
-template<typename T>
-inline typename Array<T>::Iterator Array<T>::end()
+template<typename T, typename Allocator>
+inline typename Array<T, Allocator>::Iterator Array<T, Allocator>::end()
 {
 	return m_items + m_size;
 }
 
-template<typename T>
-inline typename Array<T>::ConstIterator Array<T>::end() const
+template<typename T, typename Allocator>
+inline typename Array<T, Allocator>::ConstIterator Array<T, Allocator>::end() const
 {
 	return m_items + m_size;
 }
 
-template<typename T>
-inline typename Array<T>::ConstIterator Array<T>::cend() const
+template<typename T, typename Allocator>
+inline typename Array<T, Allocator>::ConstIterator Array<T, Allocator>::cend() const
 {
 	return m_items + m_size;
 }
 
-template<typename T>
-inline typename Array<T>::Iterator Array<T>::data()
+template<typename T, typename Allocator>
+inline typename Array<T, Allocator>::Iterator Array<T, Allocator>::data()
 {
 	return m_items;
 }
 
-template<typename T>
-inline typename Array<T>::ConstIterator Array<T>::data() const
+template<typename T, typename Allocator>
+inline typename Array<T, Allocator>::ConstIterator Array<T, Allocator>::data() const
 {
 	return m_items;
 }
 
+template<typename T, typename Allocator>
+inline void Array<T, Allocator>::reallocate(size_t newCapacity)
+{
+	T* newItems = AllocatorTraits::allocate(m_allocator, newCapacity);
+	for (size_t i = 0; i < m_size; ++i)
+	{
+		new (newItems + i) T(std::move(m_items[i]));
+		m_items[i].~T();
+	}
+	if (m_items)
+		AllocatorTraits::deallocate(m_allocator, m_items, m_capacity);
+	m_items = newItems;
+	m_capacity = newCapacity;
+}
+
+template<typename T, typename Allocator>
+inline void Array<T, Allocator>::destroy(size_t from, size_t to)
+{
+	for (size_t i = from; i < to; ++i)
+		m_items[i].~T();
+}
+
+template<typename T, typename Allocator>
+inline void Array<T, Allocator>::release()
+{
+	destroy(0, m_size);
+	if (m_items)
+		AllocatorTraits::deallocate(m_allocator, m_items, m_capacity);
+}
+
 // non-member swap function
-template <typename T>
-inline void swap(Array<T>& a, Array<T>& b) noexcept
+template <typename T, typename Allocator>
+inline void swap(Array<T, Allocator>& a, Array<T, Allocator>& b) noexcept
 {
-	a.swap(b);
+	a.swap(std::move(b));
 }
\ No newline at end of file
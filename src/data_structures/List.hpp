@@ -1,22 +1,42 @@
 #pragma once
 #include <utility>
 #include <cstddef>
+#include <memory>
+#include <new>
 #include <initializer_list>
 
-template <typename T>
+// doubly linked list with an embedded sentinel
+// nodes are allocated in chunks and recycled through a free list, so pushing and
+// popping in a steady state does not touch the allocator
+// the first node slot of every chunk holds the link to the previous chunk, so an empty
+// list allocates nothing and all memory comes from the allocator
+template <typename T, typename Allocator = std::allocator<T>>
 class List
 {
 private:
+	struct NodeBase;
 	struct Node;
+	using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+	using NodeTraits = std::allocator_traits<NodeAllocator>;
+	struct Chunk
+	{
+		Node* previous;
+		size_t count; // node slots including the one holding this header
+	};
+	static constexpr size_t FIRST_CHUNK_SIZE = 8;
+	static constexpr size_t MAX_CHUNK_SIZE = 1024;
 public:
 	class ConstIterator;
 	class Iterator;
 private:
 	size_t m_size;
-	Node* m_head;
-	Node* m_tail;
+	NodeBase m_sentinel; // before the first and after the last node
+	NodeBase* m_free; // recycled nodes linked through next
+	Node* m_chunks; // most recent chunk
+	NodeAllocator m_allocator;
 public:
 	List();
+	explicit List(const Allocator& allocator);
 	List(std::initializer_list<T> iniList);
 	List(const List& other);
 	List(List&& other) noexcept;
@@ -57,33 +77,44 @@ public:
 	Iterator erase(Iterator from, Iterator to);
 private:
 	void init();
+	void relinkSentinel(); // after the sentinel moved to another object
+	template <typename U>
+	Node* createNode(U&& t, NodeBase* prev, NodeBase* next);
+	void recycleNode(Node* node);
+	void releaseChunks();
+	static Chunk* header(Node* chunk);
+};
+
+template <typename T, typename Allocator>
+struct List<T, Allocator>::NodeBase
+{
+	NodeBase* prev;
+	NodeBase* next;
 };
 
-template <typename T>
-struct List<T>::Node
+template <typename T, typename Allocator>
+struct List<T, Allocator>::Node : NodeBase
 {
 	T item;
-	Node* prev;
-	Node* next;
-	Node(const T& t = T(), Node* p = nullptr, Node* n = nullptr)
-		: item(t), prev(p), next(n) {
+	Node(const T& t, NodeBase* p, NodeBase* n)
+		: NodeBase{ p, n }, item(t) {
 	}
-	Node(T&& t, Node* p = nullptr, Node* n = nullptr)
-		: item(std::move(t)), prev(p), next(n) {
+	Node(T&& t, NodeBase* p, NodeBase* n)
+		: NodeBase{ p, n }, item(std::move(t)) {
 	}
 };
 
-template <typename T>
-class List<T>::ConstIterator
+template <typename T, typename Allocator>
+class List<T, Allocator>::ConstIterator
 {
-	friend class List<T>;
+	friend class List<T, Allocator>;
 protected:
-	Node* m_current;
-	const List<T>* m_list;
+	NodeBase* m_current;
+	const List<T, Allocator>* m_list;
 public:
-	ConstIterator() : m_list(nullptr), m_current(nullptr) {}
-	const T& operator*() const { return m_current->item; }
-	const T* operator->() const { return &(m_current->item); }
+	ConstIterator() : m_current(nullptr), m_list(nullptr) {}
+	const T& operator*() const { return static_cast<Node*>(m_current)->item; }
+	const T* operator->() const { return &(static_cast<Node*>(m_current)->item); }
 	ConstIterator& operator++()
 	{
 		m_current = m_current->next;
@@ -115,21 +146,21 @@ public:
 		return !(*this == it);
 	}
 protected:
-	ConstIterator(const List<T>& other, Node* p) : m_list(&other), m_current(p) {}
+	ConstIterator(const List<T, Allocator>& other, NodeBase* p) : m_current(p), m_list(&other) {}
 };
 
-template<typename T>
-class List<T>::Iterator : public ConstIterator
+template<typename T, typename Allocator>
+class List<T, Allocator>::Iterator : public ConstIterator
 {
-	friend class List<T>;
+	friend class List<T, Allocator>;
 protected:
-	Iterator(const List<T>& other, Node* p) : ConstIterator(other, p) {}
+	Iterator(const List<T, Allocator>& other, NodeBase* p) : ConstIterator(other, p) {}
 public:
 	Iterator() : ConstIterator() {}
-	T& operator*() { return ConstIterator::m_current->item; }
-	const T& operator*() const { return ConstIterator::m_current->item; }
-	T* operator->() { return &(ConstIterator::m_current->item); }
-	const T* operator->() const { return &(ConstIterator::m_current->item); }
+	T& operator*() { return static_cast<Node*>(this->m_current)->item; }
+	const T& operator*() const { return static_cast<Node*>(this->m_current)->item; }
+	T* operator->() { return &(static_cast<Node*>(this->m_current)->item); }
+	const T* operator->() const { return &(static_cast<Node*>(this->m_current)->item); }
 	Iterator& operator++()
 	{
 		this->m_current = this->m_current->next;
@@ -154,115 +185,125 @@ public:
 	}
 };
 
-template<typename T>
-inline List<T>::List()
+template<typename T, typename Allocator>
+inline List<T, Allocator>::List() : m_chunks(nullptr), m_allocator()
 {
 	init();
 }
 
-template<typename T>
-inline List<T>::List(std::initializer_list<T> iniList)
+template<typename T, typename Allocator>
+inline List<T, Allocator>::List(const Allocator& allocator) : m_chunks(nullptr), m_allocator(allocator)
 {
 	init();
+}
+
+template<typename T, typename Allocator>
+inline List<T, Allocator>::List(std::initializer_list<T> iniList) : List()
+{
 	for (const auto& item : iniList)
 		pushBack(item);
 }
 
-template<typename T>
-inline List<T>::List(const List& other)
+template<typename T, typename Allocator>
+inline List<T, Allocator>::List(const List& other)
+	: m_chunks(nullptr), m_allocator(NodeTraits::select_on_container_copy_construction(other.m_allocator))
 {
 	init();
 	for (auto& x : other)
 		pushBack(x);
 }
 
-template<typename T>
-inline List<T>::List(List&& other) noexcept
-	: m_size(other.m_size), m_head(other.m_head), m_tail(other.m_tail)
+template<typename T, typename Allocator>
+inline List<T, Allocator>::List(List&& other) noexcept
+	: m_size(other.m_size), m_sentinel(other.m_sentinel), m_free(other.m_free),
+	  m_chunks(other.m_chunks), m_allocator(other.m_allocator)
 {
+	relinkSentinel();
+	other.m_chunks = nullptr;
 	other.init();
 }
 
-template<typename T>
-inline List<T>::~List()
+template<typename T, typename Allocator>
+inline List<T, Allocator>::~List()
 {
 	clear();
-	delete m_head;
-	delete m_tail;
+	releaseChunks();
 }
 
-template<typename T>
-inline List<T>& List<T>::operator=(const List<T>& other)
+template<typename T, typename Allocator>
+inline List<T, Allocator>& List<T, Allocator>::operator=(const List& other)
 {
-	List<T> copy(other);
-	std::swap(*this, copy);
+	List copy(other);
+	swap(copy);
 	return *this;
 }
 
-template<typename T>
-inline List<T>& List<T>::operator=(List<T>&& other) noexcept
+template<typename T, typename Allocator>
+inline List<T, Allocator>& List<T, Allocator>::operator=(List&& other) noexcept
 {
-	std::swap(m_size, other.m_size);
-	std::swap(m_head, other.m_head);
-	std::swap(m_tail, other.m_tail);
+	swap(other);
 	return *this;
 }
 
-template<typename T>
-inline void List<T>::swap(List& other)
+template<typename T, typename Allocator>
+inline void List<T, Allocator>::swap(List& other)
 {
 	std::swap(m_size, other.m_size);
-	std::swap(m_head, other.m_head);
-	std::swap(m_tail, other.m_tail);
+	std::swap(m_sentinel, other.m_sentinel);
+	std::swap(m_free, other.m_free);
+	std::swap(m_chunks, other.m_chunks);
+	std::swap(m_allocator, other.m_allocator);
+	relinkSentinel();
+	other.relinkSentinel();
 }
 
-template<typename T>
-typename List<T>::Iterator List<T>::begin() 
-{ 
-	return Iterator(*this, m_head->next); 
+template<typename T, typename Allocator>
+typename List<T, Allocator>::Iterator List<T, Allocator>::begin()
+{
+	return Iterator(*this, m_sentinel.next);
 }
 
-template<typename T>
-typename List<T>::ConstIterator List<T>::begin() const
-{ 
-	return ConstIterator(*this, m_head->next); 
+template<typename T, typename Allocator>
+typename List<T, Allocator>::ConstIterator List<T, Allocator>::begin() const
+{
+	return ConstIterator(*this, m_sentinel.next);
 }
 
-template<typename T>
-typename List<T>::ConstIterator List<T>::cbegin() const
-{ 
-	return ConstIterator(*this, m_head->next); 
+template<typename T, typename Allocator>
+typename List<T, Allocator>::ConstIterator List<T, Allocator>::cbegin() const
+{
+	return ConstIterator(*this, m_sentinel.next);
 }
 
-template<typename T>
-typename List<T>::Iterator List<T>::end()
-{ 
-	return Iterator(*this, m_tail); 
+template<typename T, typename Allocator>
+typename List<T, Allocator>::Iterator List<T, Allocator>::end()
+{
+	return Iterator(*this, &m_sentinel);
 }
 
-template<typename T>
-typename List<T>::ConstIterator List<T>::end() const
-{ 
-	return ConstIterator(*this, m_tail); 
+template<typename T, typename Allocator>
+typename List<T, Allocator>::ConstIterator List<T, Allocator>::end() const
+{
+	return ConstIterator(*this, const_cast<NodeBase*>(&m_sentinel));
 }
 
-template<typename T>
-typename List<T>::ConstIterator List<T>::cend() const
-{ 
-	return ConstIterator(*this, m_tail);
+template<typename T, typename Allocator>
+typename List<T, Allocator>::ConstIterator List<T, Allocator>::cend() const
+{
+	return ConstIterator(*this, const_cast<NodeBase*>(&m_sentinel));
 }
 
-template<typename T>
-size_t List<T>::size() const { return m_size; }
+template<typename T, typename Allocator>
+size_t List<T, Allocator>::size() const { return m_size; }
 
-template<typename T>
-bool List<T>::empty() const { return m_size == 0; }
+template<typename T, typename Allocator>
+bool List<T, Allocator>::empty() const { return m_size == 0; }
 
-template<typename T>
-void List<T>::clear() { while (!empty()) popFront(); }
+template<typename T, typename Allocator>
+void List<T, Allocator>::clear() { while (!empty()) popFront(); }
 
-template<typename T>
-inline bool List<T>::operator==(const List& other) const
+template<typename T, typename Allocator>
+inline bool List<T, Allocator>::operator==(const List& other) const
 {
 	if(m_size != other.m_size)
 		return false;
@@ -280,114 +321,171 @@ inline bool List<T>::operator==(const List& other) const
 	return true;
 }
 
-template<typename T>
-inline bool List<T>::operator!=(const List& other) const
+template<typename T, typename Allocator>
+inline bool List<T, Allocator>::operator!=(const List& other) const
 {
 	return !(*this == other);
 }
 
-template<typename T>
-T& List<T>::front() 
-{ 
-	return *(begin()); 
+template<typename T, typename Allocator>
+T& List<T, Allocator>::front()
+{
+	return *(begin());
 }
 
-template<typename T>
-const T& List<T>::front() const 
-{ 
-	return *(cbegin()); 
+template<typename T, typename Allocator>
+const T& List<T, Allocator>::front() const
+{
+	return *(cbegin());
 }
 
-template<typename T>
-T& List<T>::back() 
-{ 
-	return *(--end()); 
+template<typename T, typename Allocator>
+T& List<T, Allocator>::back()
+{
+	return *(--end());
 }
 
-template<typename T>
-const T& List<T>::back() const 
-{ 
-	return *(--cend()); 
+template<typename T, typename Allocator>
+const T& List<T, Allocator>::back() const
+{
+	return *(--cend());
 }
 
-template<typename T>
-void List<T>::pushFront(const T& t)
-{ 
-	insert(begin(), t); 
+template<typename T, typename Allocator>
+void List<T, Allocator>::pushFront(const T& t)
+{
+	insert(begin(), t);
 }
 
-template<typename T>
-void List<T>::pushFront(T&& t)
+template<typename T, typename Allocator>
+void List<T, Allocator>::pushFront(T&& t)
 {
-	insert(begin(), std::move(t)); 
+	insert(begin(), std::move(t));
 }
 
-template<typename T>
-void List<T>::pushBack(const T& t)
-{ 
+template<typename T, typename Allocator>
+void List<T, Allocator>::pushBack(const T& t)
+{
 	insert(end(), t);
 }
 
-template<typename T>
-void List<T>::pushBack(T&& t) 
+template<typename T, typename Allocator>
+void List<T, Allocator>::pushBack(T&& t)
 {
 	insert(end(), std::move(t));
 }
 
-template<typename T>
-void List<T>::popFront()
-{ 
-	erase(begin()); 
+template<typename T, typename Allocator>
+void List<T, Allocator>::popFront()
+{
+	erase(begin());
 }
 
-template<typename T>
-void List<T>::popBack() 
-{ 
+template<typename T, typename Allocator>
+void List<T, Allocator>::popBack()
+{
 	erase(--end());
 }
 
-template<typename T>
-inline typename List<T>::Iterator List<T>::insert(Iterator it, const T& t)
+template<typename T, typename Allocator>
+inline typename List<T, Allocator>::Iterator List<T, Allocator>::insert(Iterator it, const T& t)
 {
-	Node* p = it.m_current;
+	NodeBase* p = it.m_current;
 	m_size++;
-	return Iterator(*this, p->prev = p->prev->next = new Node(t, p->prev, p));
+	return Iterator(*this, p->prev = p->prev->next = createNode(t, p->prev, p));
 }
 
-template<typename T>
-inline typename List<T>::Iterator List<T>::insert(Iterator it, T&& t)
+template<typename T, typename Allocator>
+inline typename List<T, Allocator>::Iterator List<T, Allocator>::insert(Iterator it, T&& t)
 {
-	Node* p = it.m_current;
+	NodeBase* p = it.m_current;
 	m_size++;
-	return Iterator(*this, p->prev = p->prev->next = new Node(std::move(t), p->prev, p));
+	return Iterator(*this, p->prev = p->prev->next = createNode(std::move(t), p->prev, p));
 }
 
-template<typename T>
-inline typename List<T>::Iterator List<T>::erase(Iterator it)
+template<typename T, typename Allocator>
+inline typename List<T, Allocator>::Iterator List<T, Allocator>::erase(Iterator it)
 {
-	Node* p = it.m_current;
+	NodeBase* p = it.m_current;
 	Iterator retVal(*this, p->next);
 	p->prev->next = p->next;
 	p->next->prev = p->prev;
-	delete p;
+	recycleNode(static_cast<Node*>(p));
 	m_size--;
 	return retVal;
 }
 
-template<typename T>
-inline typename List<T>::Iterator List<T>::erase(Iterator from, Iterator to)
+template<typename T, typename Allocator>
+inline typename List<T, Allocator>::Iterator List<T, Allocator>::erase(Iterator from, Iterator to)
 {
 	for (Iterator it = from; it != to;)
 		it = erase(it);
 	return to;
 }
 
-template<typename T>
-inline void List<T>::init()
+template<typename T, typename Allocator>
+inline void List<T, Allocator>::init()
 {
 	m_size = 0;
-	m_head = new Node();
-	m_tail = new Node();
-	m_head->next = m_tail;
-	m_tail->prev = m_head;
+	m_sentinel.next = &m_sentinel;
+	m_sentinel.prev = &m_sentinel;
+	m_free = nullptr;
+}
+
+template<typename T, typename Allocator>
+inline void List<T, Allocator>::relinkSentinel()
+{
+	if (m_size == 0)
+	{
+		m_sentinel.next = &m_sentinel;
+		m_sentinel.prev = &m_sentinel;
+		return;
+	}
+	m_sentinel.next->prev = &m_sentinel;
+	m_sentinel.prev->next = &m_sentinel;
+}
+
+template<typename T, typename Allocator>
+template<typename U>
+inline typename List<T, Allocator>::Node* List<T, Allocator>::createNode(U&& t, NodeBase* prev, NodeBase* next)
+{
+	if (m_free == nullptr)
+	{
+		// new chunk, twice the previous one
+		size_t count = m_chunks == nullptr ? FIRST_CHUNK_SIZE : std::min(2 * header(m_chunks)->count, MAX_CHUNK_SIZE);
+		Node* nodes = NodeTraits::allocate(m_allocator, count);
+		new (static_cast<void*>(nodes)) Chunk{ m_chunks, count };
+		m_chunks = nodes;
+		for (size_t i = count; i-- > 1;)
+			m_free = new (static_cast<NodeBase*>(nodes + i)) NodeBase{ nullptr, m_free };
+	}
+	void* storage = static_cast<Node*>(m_free);
+	m_free = m_free->next;
+	return new (storage) Node(std::forward<U>(t), prev, next);
+}
+
+template<typename T, typename Allocator>
+inline void List<T, Allocator>::recycleNode(Node* node)
+{
+	node->~Node();
+	m_free = new (static_cast<NodeBase*>(node)) NodeBase{ nullptr, m_free };
+}
+
+template<typename T, typename Allocator>
+inline void List<T, Allocator>::releaseChunks()
+{
+	while (m_chunks != nullptr)
+	{
+		Chunk chunk = *header(m_chunks);
+		NodeTraits::deallocate(m_allocator, m_chunks, chunk.count);
+		m_chunks = chunk.previous;
+	}
+	m_free = nullptr;
+}
+
+template<typename T, typename Allocator>
+inline typename List<T, Allocator>::Chunk* List<T, Allocator>::header(Node* chunk)
+{
+	static_assert(sizeof(Chunk) <= sizeof(Node) && alignof(Chunk) <= alignof(Node), "Chunk header does not fit a node slot");
+	return std::launder(reinterpret_cast<Chunk*>(chunk));
 }
@@ -1,21 +1,42 @@
 #pragma once
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
 #include <utility>
 #include <functional>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MAP_USE_SSE2
+#include <emmintrin.h>
+#endif
+
 #include "Array.hpp"
 
+// open addressing hash map (Swiss table layout)
+// every slot has a control byte: EMPTY, DELETED or the low 7 bits of the key hash,
+// lookups compare a whole group of control bytes at once and touch a slot only on a match
+// slots are stored in one flat allocation, there is no per-element allocation
 template <typename Key, typename Value,
 		  typename Hasher = std::hash<Key>,
-		  typename KeyEqual = std::equal_to<Key>>
+		  typename KeyEqual = std::equal_to<Key>,
+		  typename Allocator = std::allocator<std::pair<const Key, Value>>>
 class Map
 {
 private:
-	struct Node;
+	using Slot = std::pair<const Key, Value>;
+	using Control = int8_t;
+	using SlotAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Slot>;
+	using SlotTraits = std::allocator_traits<SlotAllocator>;
+	using ControlAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Control>;
+	static constexpr Control EMPTY = -128;
+	static constexpr Control DELETED = -2;
+	static constexpr size_t GROUP_SIZE = 16;
+	struct Group;
 public:
 	struct ConstIterator;
 	struct Iterator;
 public:
-	explicit Map(size_t bucketCount = 8);
+	explicit Map(size_t bucketCount = 8, const Allocator& allocator = Allocator());
 	Map(const Map& other);
 	Map(Map&& other) noexcept;
 	~Map();
@@ -40,6 +61,7 @@ public:
 	bool empty() const;
 	size_t size() const;
 	size_t capacity() const;
+	void reserve(size_t count); // no rehash until size() exceeds count
 
 	void clear();
 
@@ -52,68 +74,114 @@ public:
 	Iterator erase(ConstIterator it);
 
 private:
-	Array<Node*> m_buckets;
+	Array<Control, ControlAllocator> m_control; // capacity + GROUP_SIZE bytes, the first group is cloned at the end
+	Slot* m_slots;
+	size_t m_capacity; // 0 or a power of two >= GROUP_SIZE
 	size_t m_size;
-	float m_maxLoadFactor;
+	size_t m_growthLeft; // insertions into empty slots before the next rehash
 	Hasher m_hasher;
 	KeyEqual m_keyEqual;
+	SlotAllocator m_allocator;
 
 private:
 	void rehash(size_t newCapacity);
-	size_t getBucketIndex(const Key& key) const;
-	Node* findFirstNode() const; // nullptr if not found
+	size_t hash(const Key& key) const;
+	size_t findIndex(const Key& key) const; // m_capacity if not found
+	template <typename Pair>
+	std::pair<Iterator, bool> emplace(Pair&& pair);
+	size_t findInsertIndex(size_t hash) const;
+	void setControl(size_t index, Control control);
+	size_t nextFull(size_t index) const; // first full slot at or after index
+	void destroySlots();
+	static size_t maxLoad(size_t capacity); // 7/8 of the slots
 };
 
-// Node definition
-template <typename Key, typename Value, typename Hasher, typename KeyEqual>
-struct Map<Key, Value, Hasher, KeyEqual>::Node
+// group of control bytes starting at a slot, matches are returned as bit masks
+template <typename Key, typename Value, typename Hasher, typename KeyEqual, typename Allocator>
+struct Map<Key, Value, Hasher, KeyEqual, Allocator>::Group
 {
-	std::pair<const Key, Value> pair;
-	Node* next;
-
-	Node(const Key& k, const Value& v, Node* n = nullptr)
-		: pair(k, v), next(n) {}
-	Node(const Key& k, Value&& v, Node* n = nullptr)
-		: pair(k, std::move(v)), next(n) {}
-	Node(Key&& k, Value&& v, Node* n = nullptr)
-		: pair(std::move(k), std::move(v)), next(n) {}
+#ifdef MAP_USE_SSE2
+	__m128i control;
+	explicit Group(const Control* position) : control(_mm_loadu_si128(reinterpret_cast<const __m128i*>(position))) {}
+	uint32_t match(Control h2) const
+	{
+		return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), control)));
+	}
+	uint32_t matchEmpty() const
+	{
+		return match(EMPTY);
+	}
+	uint32_t matchEmptyOrDeleted() const
+	{
+		// EMPTY and DELETED are the only negative values but not the smallest one (-1 is unused)
+		return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(-1), control)));
+	}
+#else
+	// portable fallback, same bit masks
+	Control control[GROUP_SIZE];
+	explicit Group(const Control* position)
+	{
+		for (size_t i = 0; i < GROUP_SIZE; i++)
+			control[i] = position[i];
+	}
+	uint32_t match(Control h2) const
+	{
+		uint32_t mask = 0;
+		for (size_t i = 0; i < GROUP_SIZE; i++)
+			mask |= static_cast<uint32_t>(control[i] == h2) << i;
+		return mask;
+	}
+	uint32_t matchEmpty() const
+	{
+		return match(EMPTY);
+	}
+	uint32_t matchEmptyOrDeleted() const
+	{
+		uint32_t mask = 0;
+		for (size_t i = 0; i < GROUP_SIZE; i++)
+			mask |= static_cast<uint32_t>(control[i] < -1) << i;
+		return mask;
+	}
+#endif
+	static size_t lowestBit(uint32_t mask)
+	{
+		size_t bit = 0;
+		while (!(mask & 1u))
+		{
+			mask >>= 1;
+			bit++;
+		}
+		return bit;
+	}
+	static size_t highestBit(uint32_t mask)
+	{
+		size_t bit = 0;
+		while (mask >>= 1)
+			bit++;
+		return bit;
+	}
 };
+
 //ConstIterator definition
-template <typename Key, typename Value, typename Hasher, typename KeyEqual>
-class Map<Key, Value, Hasher, KeyEqual>::ConstIterator
+template <typename Key, typename Value, typename Hasher, typename KeyEqual, typename Allocator>
+class Map<Key, Value, Hasher, KeyEqual, Allocator>::ConstIterator
 {
-	friend class Map<Key, Value, Hasher, KeyEqual>;
+	friend class Map<Key, Value, Hasher, KeyEqual, Allocator>;
 protected:
 	const Map* m_map;
-	Node* m_current;
+	size_t m_current; // slot index, capacity for end
 public:
-	ConstIterator() : m_map(nullptr), m_current(nullptr) {}
+	ConstIterator() : m_map(nullptr), m_current(0) {}
 
-	const std::pair<const Key, Value>& operator*() const { return m_current->pair; }
-	const std::pair<const Key, Value>* operator->() const { return &(m_current->pair); }
+	const std::pair<const Key, Value>& operator*() const { return m_map->m_slots[m_current]; }
+	const std::pair<const Key, Value>* operator->() const { return &(m_map->m_slots[m_current]); }
 
 	bool operator==(const ConstIterator& other) const { return m_current == other.m_current; }
 	bool operator!=(const ConstIterator& other) const { return m_current != other.m_current; }
 
 	ConstIterator& operator++()
 	{
-		// next in the bucket if not nullptr
-		if (m_current->next)
-		{
-			m_current = m_current->next;
-			return *this;
-		}
-		// next bucket otherwise
-		size_t bucketIdx = m_map->getBucketIndex(m_current->pair.first);
-		for (size_t i = bucketIdx + 1; i < m_map->capacity(); ++i)
-		{
-			if (m_map->m_buckets[i])
-			{
-				m_current = m_map->m_buckets[i];
-				return *this;
-			}
-		}
-		m_current = nullptr;
+		m_current = m_map->nextFull(m_current + 1);
 		return *this;
 	}
 	ConstIterator operator++(int)
@@ -123,21 +191,21 @@ public:
 		return old;
 	}
 protected:
-	ConstIterator(const Map* map, Node* n) : m_map(map), m_current(n) {}
+	ConstIterator(const Map* map, size_t index) : m_map(map), m_current(index) {}
 
 };
 // Iterator definition
-template <typename Key, typename Value, typename Hasher, typename KeyEqual>
-class Map<Key, Value, Hasher, KeyEqual>::Iterator : public ConstIterator
+template <typename Key, typename Value, typename Hasher, typename KeyEqual, typename Allocator>
+class Map<Key, Value, Hasher, KeyEqual, Allocator>::Iterator : public ConstIterator
 {
-	friend class Map<Key, Value, Hasher, KeyEqual>;
+	friend class Map<Key, Value, Hasher, KeyEqual, Allocator>;
 public:
 	Iterator() : ConstIterator() {}
 
-	const std::pair<const Key, Value>& operator*() const { return m_current->pair; }
-	std::pair<const Key, Value>& operator*() { return m_current->pair; }
-	const std::pair<const Key, Value>* operator->() const { return &(m_current->pair); }
-	std::pair<const Key, Value>* operator->() { return &(m_current->pair); }
+	const std::pair<const Key, Value>& operator*() const { return this->m_map->m_slots[this->m_current]; }
+	std::pair<const Key, Value>& operator*() { return this->m_map->m_slots[this->m_current]; }
+	const std::pair<const Key, Value>* operator->() const { return &(this->m_map->m_slots[this->m_current]); }
+	std::pair<const Key, Value>* operator->() { return &(this->m_map->m_slots[this->m_current]); }
 
 	Iterator& operator++()
 	{
@@ -151,149 +219,173 @@ public:
 		return old;
 	}
 private:
-	Iterator(const Map* map, Node* n) : ConstIterator(map, n) {}
+	Iterator(const Map* map, size_t index) : ConstIterator(map, index) {}
 };
 // constructors & destructor
-template<typename Key, typename Value, typename Hasher, typename KeyEqual>
-inline Map<Key, Value, Hasher, KeyEqual>::Map(size_t bucketCount)
-	: m_buckets(bucketCount > 0 ? bucketCount : 1),
-	  m_size(0), m_maxLoadFactor(1.0f) {}
-
-template<typename Key, typename Value, typename Hasher, typename KeyEqual>
-inline Map<Key, Value, Hasher, KeyEqual>::Map(const Map& other)
-	: m_buckets(other.capacity()),
+template<typename Key, typename Value, typename Hasher, typename KeyEqual, typename Allocator>
+inline Map<Key, Value, Hasher, KeyEqual, Allocator>::Map(size_t bucketCount, const Allocator& allocator)
+	: m_control(ControlAllocator(allocator)), m_slots(nullptr), m_capacity(0), m_size(0), m_growthLeft(0),
+	  m_allocator(allocator)
+{
+	reserve(bucketCount);
+}
+
+template<typename Key, typename Value, typename Hasher, typename KeyEqual, typename Allocator>
+inline Map<Key, Value, Hasher, KeyEqual, Allocator>::Map(const Map& other)
+	: m_control(other.m_control),
+	  m_slots(nullptr),
+	  m_capacity(other.m_capacity),
 	  m_size(other.m_size),
-	  m_maxLoadFactor(other.m_maxLoadFactor),
+	  m_growthLeft(other.m_growthLeft),
 	  m_hasher(other.m_hasher),
-	  m_keyEqual(other.m_keyEqual)
+	  m_keyEqual(other.m_keyEqual),
+	  m_allocator(SlotTraits::select_on_container_copy_construction(other.m_allocator))
 {
-	// deep copy
-	for (size_t i = 0; i < other.capacity(); ++i)
-	{
-		Node* currentOther = other.m_buckets[i];
-		Node** currentThis = &m_buckets[i];
-		while (currentOther)
-		{
-			*currentThis = new Node(currentOther->pair.first, currentOther->pair.second);
-			currentOther = currentOther->next;
-			currentThis = &((*currentThis)->next);
-		}
-	}
+	// same layout, full slots copied in place
+	if (m_capacity == 0)
+		return;
+	m_slots = SlotTraits::allocate(m_allocator, m_capacity);
+	for (size_t i = 0; i < m_capacity; ++i)
+		if (m_control[i] >= 0)
+			new (m_slots + i) Slot(other.m_slots[i]);
 }
 
-template<typename Key, typename Value, typename Hasher, typename KeyEqual>
-inline Map<Key, Value, Hasher, KeyEqual>::Map(Map&& other) noexcept :
-	m_buckets(std::move(other.m_buckets)),
+template<typename Key, typename Value, typename Hasher, typename KeyEqual, typename Allocator>
+inline Map<Key, Value, Hasher, KeyEqual, Allocator>::Map(Map&& other) noexcept :
+	m_control(std::move(other.m_control)),
+	m_slots(other.m_slots),
+	m_capacity(other.m_capacity),
 	m_size(other.m_size),
-	m_maxLoadFactor(other.m_maxLoadFactor),
+	m_growthLeft(other.m_growthLeft),
 	m_hasher(std::move(other.m_hasher)),
-	m_keyEqual(std::move(other.m_keyEqual))
+	m_keyEqual(std::move(other.m_keyEqual)),
+	m_allocator(other.m_allocator)
 {
+	other.m_slots = nullptr;
+	other.m_capacity = 0;
 	other.m_size = 0;
+	other.m_growthLeft = 0;
 }
 
-template<typename Key, typename Value, typename Hasher, typename KeyEqual>
-inline Map<Key, Value, Hasher, KeyEqual>::~Map()
+template<typename Key, typename Value, typename Hasher, typename KeyEqual, typename Allocator>
+inline Map<Key, Value, Hasher, KeyEqual, Allocator>::~Map()
 {
-	clear();
+	destroySlots();
+	if (m_slots)
+		SlotTraits::deallocate(m_allocator, m_slots, m_capacity);
 }
 
 // assignment & swap
-template<typename Key, typename Value, typename Hasher, typename KeyEqual>
-inline Map<Key, Value, Hasher, KeyEqual>&
-Map<Key, Value, Hasher, KeyEqual>::operator=(const Map& other)
+template<typename Key, typename Value, typename Hasher, typename KeyEqual, typename Allocator>
+inline Map<Key, Value, Hasher, KeyEqual, Allocator>&
+Map<Key, Value, Hasher, KeyEqual, Allocator>::operator=(const Map& other)
 {
 	Map copy(other);
 	swap(copy);
 	return *this;
 }
 
-template<typename Key, typename Value, typename Hasher, typename KeyEqual>
-inline Map<Key, Value, Hasher, KeyEqual>& 
-Map<Key, Value, Hasher, KeyEqual>::operator=(Map&& other) noexcept
+template<typename Key, typename Value, typename Hasher, typename KeyEqual, typename Allocator>
+inline Map<Key, Value, Hasher, KeyEqual, Allocator>&
+Map<Key, Value, Hasher, KeyEqual, Allocator>::operator=(Map&& other) noexcept
 {
 	swap(other);
 	return *this;
 }
 
-template<typename Key, typename Value, typename Hasher, typename KeyEqual>
-inline void Map<Key, Value, Hasher, KeyEqual>::swap(Map& other)
+template<typename Key, typename Value, typename Hasher, typename KeyEqual, typename Allocator>
+inline void Map<Key, Value, Hasher, KeyEqual, Allocator>::swap(Map& other)
 {
 	using std::swap;
-	swap(m_buckets, other.m_buckets);
+	swap(m_control, other.m_control);
+	swap(m_slots, other.m_slots);
+	swap(m_capacity, other.m_capacity);
 	swap(m_size, other.m_size);
-	swap(m_maxLoadFactor, other.m_maxLoadFactor);
+	swap(m_growthLeft, other.m_growthLeft);
 	swap(m_hasher, other.m_hasher);
 	swap(m_keyEqual, other.m_keyEqual);
+	swap(m_allocator, other.m_allocator);
 }
 
 // capacity
 
-template<typename Key, typename Value, typename Hasher, typename KeyEqual>
-inline bool Map<Key, Value, Hasher, KeyEqual>::empty() const
+template<typename Key, typename Value, typename Hasher, typename KeyEqual, typename Allocator>
+inline bool Map<Key, Value, Hasher, KeyEqual, Allocator>::empty() const
 {
 	return m_size == 0;
 }
 
-template<typename Key, typename Value, typename Hasher, typename KeyEqual>
-inline size_t Map<Key, Value, Hasher, KeyEqual>::size() const
+template<typename Key, typename Value, typename Hasher, typename KeyEqual, typename Allocator>
+inline size_t Map<Key, Value, Hasher, KeyEqual, Allocator>::size() const
 {
 	return m_size;
 }
 
-template<typename Key, typename Value, typename Hasher, typename KeyEqual>
-inline size_t Map<Key, Value, Hasher, KeyEqual>::capacity() const
+template<typename Key, typename Value, typename Hasher, typename KeyEqual, typename Allocator>
+inline size_t Map<Key, Value, Hasher, KeyEqual, Allocator>::capacity() const
+{
+	return m_capacity;
+}
+
+template<typename Key, typename Value, typename Hasher, typename KeyEqual, typename Allocator>
+inline void Map<Key, Value, Hasher, KeyEqual, Allocator>::reserve(size_t count)
 {
-	return m_buckets.size();
+	if (count == 0)
+		return;
+	size_t newCapacity = GROUP_SIZE;
+	while (maxLoad(newCapacity) < count)
+		newCapacity *= 2;
+	if (newCapacity > m_capacity)
+		rehash(newCapacity);
 }
 
 // iterators
-template<typename Key, typename Value, typename Hasher, typename KeyEqual>
-inline typename Map<Key, Value, Hasher, KeyEqual>::Iterator 
-Map<Key, Value, Hasher, KeyEqual>::begin()
+template<typename Key, typename Value, typename Hasher, typename KeyEqual, typename Allocator>
+inline typename Map<Key, Value, Hasher, KeyEqual, Allocator>::Iterator
+Map<Key, Value, Hasher, KeyEqual, Allocator>::begin()
 {
-	return Iterator(this, findFirstNode());
+	return Iterator(this, nextFull(0));
 }
 
-template<typename Key, typename Value, typename Hasher, typename KeyEqual>
-inline typename Map<Key, Value, Hasher, KeyEqual>::ConstIterator
-Map<Key, Value, Hasher, KeyEqual>::begin() const
+template<typename Key, typename Value, typename Hasher, typename KeyEqual, typename Allocator>
+inline typename Map<Key, Value, Hasher, KeyEqual, Allocator>::ConstIterator
+Map<Key, Value, Hasher, KeyEqual, Allocator>::begin() const
 {
-	return ConstIterator(this, findFirstNode());
+	return ConstIterator(this, nextFull(0));
 }
 
-template<typename Key, typename Value, typename Hasher, typename KeyEqual>
-inline typename Map<Key, Value, Hasher, KeyEqual>::ConstIterator
-Map<Key, Value, Hasher, KeyEqual>::cbegin() const
+template<typename Key, typename Value, typename Hasher, typename KeyEqual, typename Allocator>
+inline typename Map<Key, Value, Hasher, KeyEqual, Allocator>::ConstIterator
+Map<Key, Value, Hasher, KeyEqual, Allocator>::cbegin() const
 {
-	return ConstIterator(this, findFirstNode());
+	return ConstIterator(this, nextFull(0));
 }
 
-template<typename Key, typename Value, typename Hasher, typename KeyEqual>
-inline typename Map<Key, Value, Hasher, KeyEqual>::Iterator
-Map<Key, Value, Hasher, KeyEqual>::end()
+template<typename Key, typename Value, typename Hasher, typename KeyEqual, typename Allocator>
+inline typename Map<Key, Value, Hasher, KeyEqual, Allocator>::Iterator
+Map<Key, Value, Hasher, KeyEqual, Allocator>::end()
 {
-	return Iterator(this, nullptr);
+	return Iterator(this, m_capacity);
 }
 
-template<typename Key, typename Value, typename Hasher, typename KeyEqual>
-inline typename Map<Key, Value, Hasher, KeyEqual>::ConstIterator
-Map<Key, Value, Hasher, KeyEqual>::end() const
+template<typename Key, typename Value, typename Hasher, typename KeyEqual, typename Allocator>
+inline typename Map<Key, Value, Hasher, KeyEqual, Allocator>::ConstIterator
+Map<Key, Value, Hasher, KeyEqual, Allocator>::end() const
 {
-	return ConstIterator(this, nullptr);
+	return ConstIterator(this, m_capacity);
 }
 
-template<typename Key, typename Value, typename Hasher, typename KeyEqual>
-inline typename Map<Key, Value, Hasher, KeyEqual>::ConstIterator
-Map<Key, Value, Hasher, KeyEqual>::cend() const
+template<typename Key, typename Value, typename Hasher, typename KeyEqual, typename Allocator>
+inline typename Map<Key, Value, Hasher, KeyEqual, Allocator>::ConstIterator
+Map<Key, Value, Hasher, KeyEqual, Allocator>::cend() const
 {
-	return ConstIterator(this, nullptr);
+	return ConstIterator(this, m_capacity);
 }
 
 
 // element access, modifiers & lookup
-template<typename Key, typename Value, typename Hasher, typename KeyEqual>
-inline Value& Map<Key, Value, Hasher, KeyEqual>::operator[](const Key& key)
+template<typename Key, typename Value, typename Hasher, typename KeyEqual, typename Allocator>
+inline Value& Map<Key, Value, Hasher, KeyEqual, Allocator>::operator[](const Key& key)
 {
 	Iterator it = find(key);
 	if (it != end())
@@ -302,8 +394,8 @@ inline Value& Map<Key, Value, Hasher, KeyEqual>::operator[](const Key& key)
 	return insert({ key, Value{} }).first->second;
 }
 
-template<typename Key, typename Value, typename Hasher, typename KeyEqual>
-inline Value& Map<Key, Value, Hasher, KeyEqual>::operator[](Key&& key)
+template<typename Key, typename Value, typename Hasher, typename KeyEqual, typename Allocator>
+inline Value& Map<Key, Value, Hasher, KeyEqual, Allocator>::operator[](Key&& key)
 {
 	Iterator it = find(key);
 	if (it != end())
@@ -312,170 +404,231 @@ inline Value& Map<Key, Value, Hasher, KeyEqual>::operator[](Key&& key)
 	return insert({ std::move(key), Value{} }).first->second;
 }
 
-template<typename Key, typename Value, typename Hasher, typename KeyEqual>
-inline typename Map<Key, Value, Hasher, KeyEqual>::Iterator 
-Map<Key, Value, Hasher, KeyEqual>::find(const Key& key)
+template<typename Key, typename Value, typename Hasher, typename KeyEqual, typename Allocator>
+inline Value& Map<Key, Value, Hasher, KeyEqual, Allocator>::at(const Key& key)
 {
-	size_t bucketIdx = getBucketIndex(key);
-	Node* current = m_buckets[bucketIdx];
-	while (current)
-	{
-		if (m_keyEqual(current->pair.first, key))
-			return Iterator(this, current);
-		current = current->next;
-	}
-	return end();
+	size_t index = findIndex(key);
+	if (index == m_capacity)
+		throw std::out_of_range("Map::at - key not found");
+	return m_slots[index].second;
 }
 
-template<typename Key, typename Value, typename Hasher, typename KeyEqual>
-inline typename Map<Key, Value, Hasher, KeyEqual>::ConstIterator
-Map<Key, Value, Hasher, KeyEqual>::find(const Key& key) const
+template<typename Key, typename Value, typename Hasher, typename KeyEqual, typename Allocator>
+inline Value& Map<Key, Value, Hasher, KeyEqual, Allocator>::at(Key&& key)
 {
-	size_t bucketIdx = getBucketIndex(key);
-	Node* current = m_buckets[bucketIdx];
-	while (current)
-	{
-		if (m_keyEqual(current->pair.first, key))
-			return ConstIterator(this, current);
-		current = current->next;
-	}
-	return cend();
+	return at(static_cast<const Key&>(key));
 }
 
+template<typename Key, typename Value, typename Hasher, typename KeyEqual, typename Allocator>
+inline const Value& Map<Key, Value, Hasher, KeyEqual, Allocator>::at(const Key& key) const
+{
+	size_t index = findIndex(key);
+	if (index == m_capacity)
+		throw std::out_of_range("Map::at - key not found");
+	return m_slots[index].second;
+}
 
+template<typename Key, typename Value, typename Hasher, typename KeyEqual, typename Allocator>
+inline typename Map<Key, Value, Hasher, KeyEqual, Allocator>::Iterator
+Map<Key, Value, Hasher, KeyEqual, Allocator>::find(const Key& key)
+{
+	return Iterator(this, findIndex(key));
+}
 
-template<typename Key, typename Value, typename Hasher, typename KeyEqual>
-inline std::pair<typename Map<Key, Value, Hasher, KeyEqual>::Iterator, bool>
-Map<Key, Value, Hasher, KeyEqual>::insert(const std::pair<Key, Value>& pair)
+template<typename Key, typename Value, typename Hasher, typename KeyEqual, typename Allocator>
+inline typename Map<Key, Value, Hasher, KeyEqual, Allocator>::ConstIterator
+Map<Key, Value, Hasher, KeyEqual, Allocator>::find(const Key& key) const
 {
-	Iterator existing = find(pair.first);
-	// key already exists
-	if (existing != end())
-		return { existing, false };
+	return ConstIterator(this, findIndex(key));
+}
 
-	if (static_cast<float>(m_size + 1) / capacity() > m_maxLoadFactor)
-		rehash(capacity() * 2);
 
-	size_t bucketIdx = getBucketIndex(pair.first);
-	Node* newNode = new Node(pair.first, pair.second, m_buckets[bucketIdx]);
-	m_buckets[bucketIdx] = newNode;
-	m_size++;
 
-	return { Iterator(this, newNode), true };
+template<typename Key, typename Value, typename Hasher, typename KeyEqual, typename Allocator>
+inline std::pair<typename Map<Key, Value, Hasher, KeyEqual, Allocator>::Iterator, bool>
+Map<Key, Value, Hasher, KeyEqual, Allocator>::insert(const std::pair<Key, Value>& pair)
+{
+	return emplace(pair);
 }
 
-template<typename Key, typename Value, typename Hasher, typename KeyEqual>
-inline std::pair<typename Map<Key, Value, Hasher, KeyEqual>::Iterator, bool>
-Map<Key, Value, Hasher, KeyEqual>::insert(std::pair<Key, Value>&& pair)
+template<typename Key, typename Value, typename Hasher, typename KeyEqual, typename Allocator>
+inline std::pair<typename Map<Key, Value, Hasher, KeyEqual, Allocator>::Iterator, bool>
+Map<Key, Value, Hasher, KeyEqual, Allocator>::insert(std::pair<Key, Value>&& pair)
 {
-	Iterator existing = find(pair.first);
-	// key already exists
-	if (existing != end())
-		return { existing, false };
-
-	if (static_cast<float>(m_size + 1) / capacity() > m_maxLoadFactor)
-		rehash(capacity() * 2);
-
-	size_t bucketIdx = getBucketIndex(pair.first);
-	Node* newNode = new Node(std::move(pair.first), std::move(pair.second), m_buckets[bucketIdx]);
-	m_buckets[bucketIdx] = newNode;
-	m_size++;
-
-	return { Iterator(this, newNode), true };
+	return emplace(std::move(pair));
 }
 
-template<typename Key, typename Value, typename Hasher, typename KeyEqual>
-inline typename Map<Key, Value, Hasher, KeyEqual>::Iterator 
-Map<Key, Value, Hasher, KeyEqual>::erase(ConstIterator it)
+template<typename Key, typename Value, typename Hasher, typename KeyEqual, typename Allocator>
+inline typename Map<Key, Value, Hasher, KeyEqual, Allocator>::Iterator
+Map<Key, Value, Hasher, KeyEqual, Allocator>::erase(ConstIterator it)
 {
 	// end or other map
-	if (it.m_map != this || it.m_current == nullptr)
+	if (it.m_map != this || it.m_current >= m_capacity)
 		return end();
-	// find the node to delete and previous node to set next
-	const Key& key = it->first;
-	size_t bucketIdx = getBucketIndex(key);
-	Node* current = m_buckets[bucketIdx];
-	Node* prev = nullptr;
-
-	// find the node in the bucket to delete
-	while (current)
+	size_t index = it.m_current;
+	m_slots[index].~Slot();
+	m_size--;
+	// the slot can become empty again only if every group window covering it has an
+	// empty slot, then no probe sequence has ever passed over it
+	size_t before = (index - GROUP_SIZE) & (m_capacity - 1);
+	uint32_t emptyAfter = Group(m_control.data() + index).matchEmpty();
+	uint32_t emptyBefore = Group(m_control.data() + before).matchEmpty();
+	bool wasNeverFull = emptyAfter && emptyBefore
+		&& (GROUP_SIZE - 1 - Group::highestBit(emptyBefore)) + Group::lowestBit(emptyAfter) < GROUP_SIZE;
+	if (wasNeverFull)
 	{
-		if (current == it.m_current)
-		{
-			Iterator nextIt(this, it.m_current);
-			++nextIt;
+		setControl(index, EMPTY);
+		m_growthLeft++;
+	}
+	else
+		setControl(index, DELETED);
+	return Iterator(this, nextFull(index + 1));
+}
 
-			if (prev) // not first in the chain
-				prev->next = current->next;
-			else // first in the chain to erase
-				m_buckets[bucketIdx] = current->next;
+template<typename Key, typename Value, typename Hasher, typename KeyEqual, typename Allocator>
+inline void Map<Key, Value, Hasher, KeyEqual, Allocator>::clear()
+{
+	destroySlots();
+	for (auto& control : m_control)
+		control = EMPTY;
+	m_size = 0;
+	m_growthLeft = maxLoad(m_capacity);
+}
 
-			delete current;
-			m_size--;
-			return nextIt;
-		}
-		prev = current;
-		current = current->next;
+// priovate helpers
+template<typename Key, typename Value, typename Hasher, typename KeyEqual, typename Allocator>
+inline void Map<Key, Value, Hasher, KeyEqual, Allocator>::rehash(size_t newCapacity)
+{
+	Array<Control, ControlAllocator> oldControl{ ControlAllocator(m_allocator) };
+	oldControl.resize(newCapacity + GROUP_SIZE);
+	for (auto& control : oldControl)
+		control = EMPTY;
+	std::swap(m_control, oldControl);
+	Slot* oldSlots = m_slots;
+	size_t oldCapacity = m_capacity;
+	m_slots = SlotTraits::allocate(m_allocator, newCapacity);
+	m_capacity = newCapacity;
+	m_growthLeft = maxLoad(newCapacity) - m_size;
+	// move full slots, tombstones are dropped
+	for (size_t i = 0; i < oldCapacity; ++i)
+	{
+		if (oldControl[i] < 0)
+			continue;
+		size_t h = hash(oldSlots[i].first);
+		size_t index = findInsertIndex(h);
+		setControl(index, static_cast<Control>(h & 0x7F));
+		new (m_slots + index) Slot(std::move(oldSlots[i]));
+		oldSlots[i].~Slot();
 	}
-	return end(); // should not be reached for valid iterator
+	if (oldSlots)
+		SlotTraits::deallocate(m_allocator, oldSlots, oldCapacity);
 }
 
-template<typename Key, typename Value, typename Hasher, typename KeyEqual>
-inline void Map<Key, Value, Hasher, KeyEqual>::clear()
+template<typename Key, typename Value, typename Hasher, typename KeyEqual, typename Allocator>
+inline size_t Map<Key, Value, Hasher, KeyEqual, Allocator>::hash(const Key& key) const
 {
-	for (size_t i = 0; i < capacity(); ++i)
+	// mix the user hash, identity hashes of integers would leave the 7 tag bits
+	// equal for all keys of one probe group
+	uint64_t h = static_cast<uint64_t>(m_hasher(key));
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return static_cast<size_t>(h);
+}
+
+template<typename Key, typename Value, typename Hasher, typename KeyEqual, typename Allocator>
+inline size_t Map<Key, Value, Hasher, KeyEqual, Allocator>::findIndex(const Key& key) const
+{
+	if (m_capacity == 0)
+		return m_capacity;
+	size_t h = hash(key);
+	const Control h2 = static_cast<Control>(h & 0x7F);
+	const size_t mask = m_capacity - 1;
+	// triangular probing over groups visits every group once
+	size_t position = (h >> 7) & mask;
+	for (size_t step = GROUP_SIZE; ; step += GROUP_SIZE)
 	{
-		Node* current = m_buckets[i];
-		while (current)
+		Group group(m_control.data() + position);
+		for (uint32_t match = group.match(h2); match; match &= match - 1)
 		{
-			Node* toDelete = current;
-			current = current->next;
-			delete toDelete;
+			size_t index = (position + Group::lowestBit(match)) & mask;
+			if (m_keyEqual(m_slots[index].first, key))
+				return index;
 		}
-		m_buckets[i] = nullptr;
+		if (group.matchEmpty())
+			return m_capacity;
+		position = (position + step) & mask;
 	}
-	m_size = 0;
 }
 
-// priovate helpers
-template<typename Key, typename Value, typename Hasher, typename KeyEqual>
-inline void Map<Key, Value, Hasher, KeyEqual>::rehash(size_t newCapacity)
+template<typename Key, typename Value, typename Hasher, typename KeyEqual, typename Allocator>
+template<typename Pair>
+inline std::pair<typename Map<Key, Value, Hasher, KeyEqual, Allocator>::Iterator, bool>
+Map<Key, Value, Hasher, KeyEqual, Allocator>::emplace(Pair&& pair)
 {
-	if (newCapacity <= capacity())
-		return;
-
-	Array<Node*> oldBuckets(0);
-	std::swap(m_buckets, oldBuckets);
-
-	m_buckets.resize(newCapacity);
-	// relink nodes
-	for (size_t i = 0; i < oldBuckets.size(); ++i)
+	size_t existing = findIndex(pair.first);
+	// key already exists
+	if (existing != m_capacity)
+		return { Iterator(this, existing), false };
+	size_t h = hash(pair.first);
+	size_t index = m_capacity > 0 ? findInsertIndex(h) : 0;
+	if (m_capacity == 0 || (m_growthLeft == 0 && m_control[index] == EMPTY))
 	{
-		Node* current = oldBuckets[i];
-		while (current)
-		{
-			Node* next = current->next;
-			size_t newIndex = getBucketIndex(current->pair.first);
-			current->next = m_buckets[newIndex];
-			m_buckets[newIndex] = current;
+		// grow, or only drop tombstones if they take most of the load
+		rehash(m_capacity == 0 ? GROUP_SIZE : (m_size * 2 > maxLoad(m_capacity) ? m_capacity * 2 : m_capacity));
+		index = findInsertIndex(h);
+	}
+	if (m_control[index] == EMPTY)
+		m_growthLeft--;
+	setControl(index, static_cast<Control>(h & 0x7F));
+	new (m_slots + index) Slot(std::forward<Pair>(pair));
+	m_size++;
+	return { Iterator(this, index), true };
+}
 
-			current = next;
-		}
+template<typename Key, typename Value, typename Hasher, typename KeyEqual, typename Allocator>
+inline size_t Map<Key, Value, Hasher, KeyEqual, Allocator>::findInsertIndex(size_t hash) const
+{
+	const size_t mask = m_capacity - 1;
+	size_t position = (hash >> 7) & mask;
+	for (size_t step = GROUP_SIZE; ; step += GROUP_SIZE)
+	{
+		uint32_t free = Group(m_control.data() + position).matchEmptyOrDeleted();
+		if (free)
+			return (position + Group::lowestBit(free)) & mask;
+		position = (position + step) & mask;
 	}
 }
 
-template<typename Key, typename Value, typename Hasher, typename KeyEqual>
-inline size_t Map<Key, Value, Hasher, KeyEqual>::getBucketIndex(const Key& key) const
+template<typename Key, typename Value, typename Hasher, typename KeyEqual, typename Allocator>
+inline void Map<Key, Value, Hasher, KeyEqual, Allocator>::setControl(size_t index, Control control)
+{
+	m_control[index] = control;
+	// keep the clone of the first group, groups are loaded unaligned across the end
+	if (index < GROUP_SIZE)
+		m_control[m_capacity + index] = control;
+}
+
+template<typename Key, typename Value, typename Hasher, typename KeyEqual, typename Allocator>
+inline size_t Map<Key, Value, Hasher, KeyEqual, Allocator>::nextFull(size_t index) const
+{
+	while (index < m_capacity && m_control[index] < 0)
+		index++;
+	return index;
+}
+
+template<typename Key, typename Value, typename Hasher, typename KeyEqual, typename Allocator>
+inline void Map<Key, Value, Hasher, KeyEqual, Allocator>::destroySlots()
 {
-	return m_hasher(key) % capacity();
+	for (size_t i = 0; i < m_capacity; ++i)
+		if (m_control[i] >= 0)
+			m_slots[i].~Slot();
 }
 
-template<typename Key, typename Value, typename Hasher, typename KeyEqual>
-inline typename Map<Key, Value, Hasher, KeyEqual>::Node* 
-Map<Key, Value, Hasher, KeyEqual>::findFirstNode() const
+template<typename Key, typename Value, typename Hasher, typename KeyEqual, typename Allocator>
+inline size_t Map<Key, Value, Hasher, KeyEqual, Allocator>::maxLoad(size_t capacity)
 {
-	for (auto& bucket : m_buckets)
-		if (bucket)
-			return bucket;
-	return nullptr; // empty map
+	return capacity - capacity / 8;
 }
@@ -1,4 +1,7 @@
 #pragma once
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include "Point.hpp"
 #include "tools/Random.hpp"
 #include "data_structures/Array.hpp"
@@ -23,11 +26,26 @@ public:
     AABB getBoundingBox() const;
     double minDist() const;
     bool pointInBoundaries(const Point& p) const;
+private:
+    void buildIndex();
+    bool crossesRay(size_t edge, const Point& p, double xEnd) const;
 private:
 	Array<Point> m_outer;
 	Array<Array<Point>> m_inner;
     AABB m_boundingBox;
     double m_minDist;
+    // uniform grid index of boundary edges with inside/outside classification of edge-free cells
+    enum class CellState : unsigned char { OUTSIDE, INSIDE, MIXED };
+    struct Edge
+    {
+        Point a, b;
+    };
+    Array<Edge> m_edges; // edges of all polygons (parity of crossings decides inside)
+    size_t m_cellsX = 0, m_cellsY = 0;
+    double m_cellSize = 0.0;
+    Array<size_t> m_cellEdgePtr; // cell -> edges touching it (CSR)
+    Array<size_t> m_cellEdges;
+    Array<CellState> m_cellStates;
 };
 
 Boundaries::Boundaries()
@@ -196,6 +214,7 @@ Boundaries::Boundaries()
             if (distance < m_minDist)
                 m_minDist = distance;
         }
+    buildIndex();
 }
 
 inline const Array<Point>& Boundaries::getOuterBoundary() const
@@ -220,10 +239,148 @@ inline double Boundaries::minDist() const
 
 inline bool Boundaries::pointInBoundaries(const Point& p) const
 {
-    if (!pointInPolygon(p, m_outer))
+    if (p[0] < m_boundingBox.xMin || p[0] > m_boundingBox.xMax || p[1] < m_boundingBox.yMin || p[1] > m_boundingBox.yMax)
         return false;
+    size_t cx = std::min(static_cast<size_t>((p[0] - m_boundingBox.xMin) / m_cellSize), m_cellsX - 1);
+    size_t cy = std::min(static_cast<size_t>((p[1] - m_boundingBox.yMin) / m_cellSize), m_cellsY - 1);
+    size_t cell = cy * m_cellsX + cx;
+    if (m_cellStates[cell] != CellState::MIXED)
+        return m_cellStates[cell] == CellState::INSIDE;
+    // ray to the right up to the first classified cell of the row,
+    // each crossing is counted only in the cell containing it
+    bool inside = false;
+    double xStart = p[0];
+    for (; cx < m_cellsX; cx++, cell++)
+    {
+        double cellXMax = m_boundingBox.xMin + (cx + 1) * m_cellSize;
+        if (m_cellStates[cell] != CellState::MIXED)
+            return inside != (m_cellStates[cell] == CellState::INSIDE);
+        double xEnd = cx + 1 == m_cellsX ? std::numeric_limits<double>::max() : cellXMax;
+        for (size_t k = m_cellEdgePtr[cell]; k < m_cellEdgePtr[cell + 1]; k++)
+        {
+            if (crossesRay(m_cellEdges[k], p, xEnd))
+            {
+                // crossing left of this cell was already counted in a previous cell
+                const Edge& e = m_edges[m_cellEdges[k]];
+                double xIntersect = e.a[0] + (p[1] - e.a[1]) * (e.b[0] - e.a[0]) / (e.b[1] - e.a[1]);
+                if (xIntersect >= xStart)
+                    inside = !inside;
+            }
+        }
+        xStart = cellXMax;
+    }
+    // ray left the grid, outside beyond the bounding box
+    return inside;
+}
+
+inline bool Boundaries::crossesRay(size_t edge, const Point& p, double xEnd) const
+{
+    // same half-open convention as pointInPolygon, crossing x in (p.x, xEnd)
+    const Point* low = &m_edges[edge].a;
+    const Point* high = &m_edges[edge].b;
+    if ((*low)[1] > (*high)[1])
+        std::swap(low, high);
+    if (p[1] <= (*low)[1] || p[1] > (*high)[1])
+        return false;
+    double xIntersect = (*low)[0] + (p[1] - (*low)[1]) * ((*high)[0] - (*low)[0]) / ((*high)[1] - (*low)[1]);
+    return xIntersect > p[0] && xIntersect < xEnd;
+}
+
+inline void Boundaries::buildIndex()
+{
+    m_edges.clear();
+    auto addPolygon = [&](const Array<Point>& polygon)
+        {
+            for (size_t i = 0; i < polygon.size(); i++)
+                m_edges.pushBack({ polygon[i], polygon[(i + 1) % polygon.size()] });
+        };
+    addPolygon(m_outer);
     for (const auto& inner : m_inner)
-        if (pointInPolygon(p, inner))
-            return false;
-    return true;
+        addPolygon(inner);
+    // about one cell per edge
+    double width = m_boundingBox.xMax - m_boundingBox.xMin;
+    double height = m_boundingBox.yMax - m_boundingBox.yMin;
+    m_cellSize = std::max(std::sqrt(width * height / std::max<size_t>(m_edges.size(), 1)), 1e-12 * std::max(width, height));
+    m_cellsX = std::max<size_t>(static_cast<size_t>(std::ceil(width / m_cellSize)), 1);
+    m_cellsY = std::max<size_t>(static_cast<size_t>(std::ceil(height / m_cellSize)), 1);
+    const size_t cellCount = m_cellsX * m_cellsY;
+    // cells touched by each edge - clip the edge to every row band it spans (conservative)
+    const double pad = 1e-9 * m_cellSize;
+    auto forEachCell = [&](const Edge& e, auto&& function)
+        {
+            double yLow = std::min(e.a[1], e.b[1]);
+            double yHigh = std::max(e.a[1], e.b[1]);
+            auto toCell = [](double value, size_t count)
+                {
+                    return static_cast<size_t>(std::clamp(value, 0.0, static_cast<double>(count - 1)));
+                };
+            size_t rowBegin = toCell((yLow - pad - m_boundingBox.yMin) / m_cellSize, m_cellsY);
+            size_t rowEnd = toCell((yHigh + pad - m_boundingBox.yMin) / m_cellSize, m_cellsY);
+            for (size_t row = rowBegin; row <= rowEnd; row++)
+            {
+                double bandLow = std::max(yLow, m_boundingBox.yMin + row * m_cellSize);
+                double bandHigh = std::min(yHigh, m_boundingBox.yMin + (row + 1) * m_cellSize);
+                double x0, x1;
+                if (e.a[1] == e.b[1])
+                {
+                    x0 = std::min(e.a[0], e.b[0]);
+                    x1 = std::max(e.a[0], e.b[0]);
+                }
+                else
+                {
+                    auto xAt = [&](double y) { return e.a[0] + (y - e.a[1]) * (e.b[0] - e.a[0]) / (e.b[1] - e.a[1]); };
+                    x0 = std::min(xAt(bandLow), xAt(bandHigh));
+                    x1 = std::max(xAt(bandLow), xAt(bandHigh));
+                }
+                size_t colBegin = toCell((x0 - pad - m_boundingBox.xMin) / m_cellSize, m_cellsX);
+                size_t colEnd = toCell((x1 + pad - m_boundingBox.xMin) / m_cellSize, m_cellsX);
+                for (size_t col = colBegin; col <= colEnd; col++)
+                    function(row * m_cellsX + col);
+            }
+        };
+    // counting sort into cells
+    m_cellEdgePtr = Array<size_t>(cellCount + 1, 0);
+    for (const Edge& e : m_edges)
+        forEachCell(e, [&](size_t cell) { m_cellEdgePtr[cell + 1]++; });
+    for (size_t c = 0; c < cellCount; c++)
+        m_cellEdgePtr[c + 1] += m_cellEdgePtr[c];
+    m_cellEdges = Array<size_t>(m_cellEdgePtr[cellCount]);
+    Array<size_t> fill(m_cellEdgePtr);
+    for (size_t i = 0; i < m_edges.size(); i++)
+        forEachCell(m_edges[i], [&](size_t cell) { m_cellEdges[fill[cell]++] = i; });
+    // classify edge-free cells by scanning the row through the cell centers
+    m_cellStates = Array<CellState>(cellCount, CellState::MIXED);
+    Array<double> crossings;
+    Array<size_t> lastRow(m_edges.size(), std::numeric_limits<size_t>::max());
+    for (size_t row = 0; row < m_cellsY; row++)
+    {
+        Point center{ 0.0, m_boundingBox.yMin + (row + 0.5) * m_cellSize };
+        crossings.clear();
+        for (size_t c = row * m_cellsX; c < (row + 1) * m_cellsX; c++)
+            for (size_t k = m_cellEdgePtr[c]; k < m_cellEdgePtr[c + 1]; k++)
+            {
+                size_t edge = m_cellEdges[k];
+                if (lastRow[edge] == row)
+                    continue;
+                lastRow[edge] = row;
+                center[0] = -std::numeric_limits<double>::max();
+                if (crossesRay(edge, center, std::numeric_limits<double>::max()))
+                {
+                    const Edge& e = m_edges[edge];
+                    crossings.pushBack(e.a[0] + (center[1] - e.a[1]) * (e.b[0] - e.a[0]) / (e.b[1] - e.a[1]));
+                }
+            }
+        std::sort(crossings.begin(), crossings.end());
+        // crossings to the right of the center decide
+        size_t passed = 0;
+        for (size_t col = 0; col < m_cellsX; col++)
+        {
+            size_t cell = row * m_cellsX + col;
+            center[0] = m_boundingBox.xMin + (col + 0.5) * m_cellSize;
+            while (passed < crossings.size() && crossings[passed] <= center[0])
+                passed++;
+            if (m_cellEdgePtr[cell] == m_cellEdgePtr[cell + 1])
+                m_cellStates[cell] = (crossings.size() - passed) % 2 == 1 ? CellState::INSIDE : CellState::OUTSIDE;
+        }
+    }
 }
@@ -1,25 +1,24 @@
 #pragma once
 
-#include <memory>
+#include <cmath>
 #include <limits>
+#include <random>
 
-#include "data_structures/List.hpp"
 #include "data_structures/Array.hpp"
 
 #include "Point.hpp"
 #include "Boundaries.hpp"
 #include "PoissonRadiusField.hpp"
 #include "tools/Random.hpp"
+#include "tools/ThreadPool.hpp"
 
-struct Cell
-{
-	size_t row, col;
-	Cell(size_t i, size_t j) : row(i), col(j) {}
-	Cell() : row(std::numeric_limits<size_t>::max()), col(std::numeric_limits<size_t>::max()) {}
-};
-
+// Poisson-disc sampling on a background grid holding at most one sample per cell
+// the box is split into square tiles processed in four phases: tiles of one phase are
+// two tiles apart, so they can grow samples concurrently without touching shared cells
 class BridsonGrid
 {
+private:
+	struct Tile;
 public:
 	BridsonGrid(const Boundaries& boundaries);
 	~BridsonGrid() = default;
@@ -29,20 +28,43 @@ public:
 	BridsonGrid& operator=(BridsonGrid&&) = delete;
 	void generateInnerPoints(Array<Point>& points);
 private:
-	void addPoint(Array<Point>& points);
+	void processTile(Tile& tile);
+	void addPoint(Tile& tile);
+	void insertSample(const Point& p);
+	void mergeTile(Tile& tile);
+	const Point& sample(size_t cell, const Tile& tile) const;
+	size_t cellIndex(const Point& p) const;
+	size_t tileIndex(size_t cell) const;
 	bool filled() const;
 private:
-	Array<Array<std::unique_ptr<Point>>> m_grid;
-	List<Cell> m_activeCells;
+	static constexpr size_t EMPTY = std::numeric_limits<size_t>::max();
+	// marks a sample of the running phase, the rest of the index points into the tile samples
+	static constexpr size_t PENDING = size_t(1) << (std::numeric_limits<size_t>::digits - 1);
+	Array<Point> m_samples; // boundary points followed by generated points
+	size_t m_boundarySampleCount = 0;
+	Array<size_t> m_grid; // flat column-major grid of sample indices (at most one per cell)
+	Array<Tile> m_tiles; // column-major
 	PoissonRadiusField m_radiusField;
 	const Boundaries& m_boundaries;
 	double m_cellSize;
-	double m_xSize;
-	double m_ySize;
+	size_t m_columns;
+	size_t m_rows;
+	size_t m_tileCells; // tile side in grid cells
+	size_t m_tileColumns;
+	size_t m_tileRows;
 	const int m_maxAttempts = 50;
+	const double m_radiusFactor = 1.5; // candidates are drawn from [R, factor * R]
 	AABB m_box;
 };
 
+struct BridsonGrid::Tile
+{
+	Array<size_t> active; // cells of active samples inside the tile, unordered
+	Array<size_t> outbox; // cells of the samples of this phase, merged into m_samples afterwards
+	Array<Point> samples; // samples of this phase, in outbox order
+	std::mt19937 engine; // per tile stream, the result does not depend on the thread count
+};
+
 BridsonGrid::BridsonGrid(const Boundaries& boundaries) : m_boundaries(boundaries), m_radiusField(boundaries)
 {
 	// bounding box for indices calculation
@@ -52,106 +74,156 @@ BridsonGrid::BridsonGrid(const Boundaries& boundaries) : m_boundaries(boundaries
 	// cell size based on minimal radius
 	double minRadius = boundaries.minDist() * 0.999;
 	m_cellSize = minRadius / std::sqrt(2.0);
-	// maximal indices
-	size_t iMax = std::ceil(xSize / m_cellSize);
-	size_t jMax = std::ceil(ySize / m_cellSize);
-	m_grid.resize(iMax);
-	for (auto& row : m_grid)
-		row.resize(jMax);
-	// insert boundary points into grid and active list
+	// maximal indices (points on the upper box sides map to the last cell)
+	m_columns = static_cast<size_t>(std::floor(xSize / m_cellSize)) + 1;
+	m_rows = static_cast<size_t>(std::floor(ySize / m_cellSize)) + 1;
+	m_grid = Array<size_t>(m_columns * m_rows, EMPTY);
+	// a tile writes up to one candidate offset outside itself and reads one search range
+	// further, the gap of one tile between concurrent tiles has to cover both
+	double reach = m_radiusFactor * m_radiusField.maxRadius() + m_cellSize;
+	m_tileCells = static_cast<size_t>(std::ceil(3.0 * reach / m_cellSize));
+	m_tileColumns = (m_columns + m_tileCells - 1) / m_tileCells;
+	m_tileRows = (m_rows + m_tileCells - 1) / m_tileCells;
+	m_tiles = Array<Tile>(m_tileColumns * m_tileRows);
+	for (auto& tile : m_tiles)
+		tile.engine = Random::stream();
+	// insert boundary points into grid and active lists
 	for (const auto& p : boundaries.getOuterBoundary())
-	{
-		size_t i = std::floor((p[0] - m_box.xMin) / m_cellSize);
-		size_t j = std::floor((p[1] - m_box.yMin) / m_cellSize);
-		m_grid[i][j] = nullptr;
-		m_grid[i][j] = std::make_unique<Point>(p);
-		m_activeCells.pushBack(Cell(i, j));
-	}
+		insertSample(p);
 	for(const auto& inner : boundaries.getInnerBoundaries())
 		for (const auto& p : inner)
-		{
-			size_t i = std::floor((p[0] - m_box.xMin) / m_cellSize);
-			size_t j = std::floor((p[1] - m_box.yMin) / m_cellSize);
-			m_grid[i][j] = std::make_unique<Point>(p);
-			m_activeCells.pushBack(Cell(i, j));
-		}
+			insertSample(p);
+	m_boundarySampleCount = m_samples.size();
 }
 
 inline void BridsonGrid::generateInnerPoints(Array<Point>& points)
 {
+	ThreadPool& pool = ThreadPool::instance();
+	Array<size_t> phaseTiles;
 	while (!filled())
-		addPoint(points);
-}
-
-inline void BridsonGrid::addPoint(Array<Point>& points)
-{
-	// attemot to generate a point around point in random active cell
-	size_t activeCellIdx = Random::get<size_t>(0, m_activeCells.size() - 1);
-	List<Cell>::Iterator activeCellIterator = m_activeCells.begin();
-	if (activeCellIdx < m_activeCells.size() / 2)
-	{
-		for (size_t idx = 0; idx < activeCellIdx; idx++)
-		{
-			++activeCellIterator;
-		}
-	}
-	else
 	{
-		activeCellIterator = m_activeCells.end();
-		for (size_t idx = m_activeCells.size(); idx > activeCellIdx; idx--)
+		for (size_t phase = 0; phase < 4; phase++)
 		{
-			--activeCellIterator;
+			phaseTiles.clear();
+			for (size_t ti = phase / 2; ti < m_tileColumns; ti += 2)
+				for (size_t tj = phase % 2; tj < m_tileRows; tj += 2)
+					if (!m_tiles[ti * m_tileRows + tj].active.empty())
+						phaseTiles.pushBack(ti * m_tileRows + tj);
+			pool.run(phaseTiles.size(), [&](size_t k) { processTile(m_tiles[phaseTiles[k]]); });
+			// in tile order, so sample indices do not depend on the thread count
+			for (size_t t : phaseTiles)
+				mergeTile(m_tiles[t]);
 		}
 	}
-	const auto& cell = *activeCellIterator;
-	const auto& point = m_grid[cell.row][cell.col];
-	std::unique_ptr<Point> newPoint = nullptr;
-	for (int i = 0; i < m_maxAttempts; i++)
+	// in cell order, the triangulation result depends on the point order
+	points.reserve(points.size() + m_samples.size() - m_boundarySampleCount);
+	for (size_t idx : m_grid)
+		if (idx != EMPTY && idx >= m_boundarySampleCount)
+			points.pushBack(m_samples[idx]);
+}
+
+inline void BridsonGrid::processTile(Tile& tile)
+{
+	while (!tile.active.empty())
+		addPoint(tile);
+}
+
+inline void BridsonGrid::addPoint(Tile& tile)
+{
+	// attemot to generate a point around random active sample
+	size_t activeIdx = Random::get<size_t>(0, tile.active.size() - 1, tile.engine);
+	const Point point = sample(tile.active[activeIdx], tile);
+	// swap-remove from the active list
+	tile.active[activeIdx] = tile.active.back();
+	tile.active.popBack();
+	const int columns = static_cast<int>(m_columns);
+	const int rows = static_cast<int>(m_rows);
+	for (int attempt = 0; attempt < m_maxAttempts; attempt++)
 	{
-		double poissonRadius = m_radiusField.getRadius(*point);
-		double radiusFactor = 1.5;
-		double r = Random::get(poissonRadius, radiusFactor * poissonRadius);
-		double phi = Random::get(0.0, 2.0 * pi());
-		int gridSearchRange = static_cast<int>(std::ceil(radiusFactor * poissonRadius / m_cellSize));
-		Point candidatePoint{(*point)[0] + r * std::cos(phi), (*point)[1] + r * std::sin(phi)};
-		int I = std::floor((candidatePoint[0]  - m_box.xMin) / m_cellSize);
-		int J = std::floor((candidatePoint[1] - m_box.yMin) / m_cellSize);
+		double poissonRadius = m_radiusField.getRadius(point);
+		double r = Random::get(poissonRadius, m_radiusFactor * poissonRadius, tile.engine);
+		double phi = Random::get(0.0, 2.0 * pi(), tile.engine);
+		int gridSearchRange = static_cast<int>(std::ceil(m_radiusFactor * poissonRadius / m_cellSize));
+		Point candidatePoint{point[0] + r * std::cos(phi), point[1] + r * std::sin(phi)};
+		int I = static_cast<int>(std::floor((candidatePoint[0]  - m_box.xMin) / m_cellSize));
+		int J = static_cast<int>(std::floor((candidatePoint[1] - m_box.yMin) / m_cellSize));
 
 		bool minDistAchived = true;
-		for (int i = std::max(I - gridSearchRange, 0); i <= std::min(I + gridSearchRange, static_cast<int>(m_grid.size()) - 1); i++)
+		for (int i = std::max(I - gridSearchRange, 0); i <= std::min(I + gridSearchRange, columns - 1) && minDistAchived; i++)
 		{
-			for (int j = std::max(J - gridSearchRange, 0); j <= std::min(J + gridSearchRange, static_cast<int>(m_grid[0].size()) - 1); j++)
+			const size_t column = static_cast<size_t>(i) * m_rows;
+			for (int j = std::max(J - gridSearchRange, 0); j <= std::min(J + gridSearchRange, rows - 1); j++)
 			{
-				if(m_grid[i][j])
-					if (dist(candidatePoint, *(m_grid[i][j])) < poissonRadius)
-					{
-						minDistAchived = false;
-						break;
-					}
+				if (m_grid[column + j] != EMPTY && dist(candidatePoint, sample(column + j, tile)) < poissonRadius)
+				{
+					minDistAchived = false;
+					break;
+				}
 			}
-			if (minDistAchived == false)
-				break;
 		}
-		bool inDomain = m_boundaries.pointInBoundaries(candidatePoint);
-		if (inDomain && minDistAchived)
+		if (minDistAchived && m_boundaries.pointInBoundaries(candidatePoint))
 		{
-			newPoint = std::make_unique<Point>(candidatePoint);
+			// cells within reach are owned by this tile during the phase
+			size_t cell = cellIndex(candidatePoint);
+			m_grid[cell] = PENDING | tile.samples.size();
+			tile.samples.pushBack(candidatePoint);
+			tile.outbox.pushBack(cell);
+			if (&m_tiles[tileIndex(cell)] == &tile)
+				tile.active.pushBack(cell);
 			break;
 		}
 	}
-	m_activeCells.erase(activeCellIterator);
-	if (newPoint)
+}
+
+inline void BridsonGrid::insertSample(const Point& p)
+{
+	size_t cell = cellIndex(p);
+	m_grid[cell] = m_samples.size();
+	m_samples.pushBack(p);
+	m_tiles[tileIndex(cell)].active.pushBack(cell);
+}
+
+inline void BridsonGrid::mergeTile(Tile& tile)
+{
+	// pending indices become sample indices, samples that fell into a neighbouring tile
+	// are handed over to its active list
+	for (size_t k = 0; k < tile.outbox.size(); k++)
 	{
-		points.pushBack(*newPoint);
-		size_t i = std::floor(((*newPoint)[0] - m_box.xMin) / m_cellSize);
-		size_t j = std::floor(((*newPoint)[1] - m_box.yMin) / m_cellSize);
-		m_grid[i][j] = std::move(newPoint);
-		m_activeCells.pushBack(Cell(i, j));
+		size_t cell = tile.outbox[k];
+		m_grid[cell] = m_samples.size();
+		m_samples.pushBack(tile.samples[k]);
+		Tile& owner = m_tiles[tileIndex(cell)];
+		if (&owner != &tile)
+			owner.active.pushBack(cell);
 	}
+	tile.outbox.clear();
+	tile.samples.clear();
 }
 
+inline const Point& BridsonGrid::sample(size_t cell, const Tile& tile) const
+{
+	size_t idx = m_grid[cell];
+	return (idx & PENDING) ? tile.samples[idx & ~PENDING] : m_samples[idx];
+}
+
+inline size_t BridsonGrid::cellIndex(const Point& p) const
+{
+	size_t i = static_cast<size_t>(std::floor((p[0] - m_box.xMin) / m_cellSize));
+	size_t j = static_cast<size_t>(std::floor((p[1] - m_box.yMin) / m_cellSize));
+	return i * m_rows + j;
+}
+
+inline size_t BridsonGrid::tileIndex(size_t cell) const
+{
+	size_t i = cell / m_rows;
+	size_t j = cell % m_rows;
+	return (i / m_tileCells) * m_tileRows + j / m_tileCells;
+}
 
 inline bool BridsonGrid::filled() const
 {
-	return m_activeCells.empty();
-}
\ No newline at end of file
+	for (const auto& tile : m_tiles)
+		if (!tile.active.empty())
+			return false;
+	return true;
+}
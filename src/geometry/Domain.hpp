@@ -52,12 +52,7 @@ inline const Array<Point>& Domain::getTriangles() const
 
 inline bool Domain::pointInDomain(const Point& p) const
 {
-	if (!pointInPolygon(p, m_boundaries.getOuterBoundary()))
-		return false;
-	for (const auto& innerBoundary : m_boundaries.getInnerBoundaries())
-		if (pointInPolygon(p, innerBoundary))
-			return false;
-	return true;
+	return m_boundaries.pointInBoundaries(p);
 }
 
 inline const Triangulation& Domain::getTriangulation() const
@@ -1,223 +1,290 @@
 #pragma once
 #include <algorithm>
 #include <limits>
+#include <stdexcept>
 
 #include "data_structures/Array.hpp"
+#include "data_structures/StaticArray.hpp"
+#include "tools/ThreadPool.hpp"
 #include "Point.hpp"
 
+// implicit kd-tree: the points are stored in median order in a single array
+// the node of the range [begin, end) is its middle element, its subtrees are
+// [begin, middle) and (middle, end), small ranges are leaf buckets scanned linearly
+// equally distant points are resolved by their position in the tree, so results do not
+// depend on the traversal order
 template <typename PointType, size_t K>
 class KDTree
 {
 	static_assert(K > 0, "KDTree dimension K must be grater than 0");
 
 private:
-	struct Node;
+	struct Range;
+	static constexpr size_t LEAF_SIZE = 8;
+	static constexpr size_t MAX_STACK = 128; // pending ranges, bounded by the tree depth
+	static constexpr size_t NONE = std::numeric_limits<size_t>::max();
 private:
-
-	Node* m_root;
-	size_t m_size; // number of points in the tree
+	Array<PointType> m_points;
 
 public:
-	KDTree();
+	KDTree() = default;
 	explicit KDTree(Array<PointType> points); // by value - will modify
-	KDTree(const KDTree& other);
-	KDTree(KDTree&& other) noexcept;
-	~KDTree();
+	KDTree(const KDTree& other) = default;
+	KDTree(KDTree&& other) noexcept = default;
+	~KDTree() = default;
 
-	KDTree& operator=(const KDTree& other);
-	KDTree& operator=(KDTree&& other) noexcept;
+	KDTree& operator=(const KDTree& other) = default;
+	KDTree& operator=(KDTree&& other) noexcept = default;
 
 	void swap(KDTree& other) noexcept;
 
 	template <typename QueryPointType>
 	PointType findNearest(const QueryPointType& target) const;
+	// nearest point for each target, queries are reordered by the leaf they fall into
+	// so that each search starts from the previous result
+	template <typename QueryPointType>
+	void findNearest(const Array<QueryPointType>& targets, Array<PointType>& nearest) const;
+	// up to k nearest points sorted by distance
+	template <typename QueryPointType>
+	void findKNearest(const QueryPointType& target, size_t k, Array<PointType>& nearest) const;
+	// all points within the (closed) radius, in tree order
+	template <typename QueryPointType>
+	void findInRadius(const QueryPointType& target, double radius, Array<PointType>& found) const;
 
 	bool empty() const noexcept;
 	size_t size() const noexcept;
 
 private:
-	Node* buildRecursive(Array<PointType>& points, size_t left, size_t right, size_t depth);
+	void build(size_t begin, size_t end, size_t depth);
+	// calls visit(index, distSq) for every point that can lie within boundSq,
+	// visit may shrink boundSq
+	template <typename QueryPointType, typename Visitor>
+	void search(const QueryPointType& target, double& boundSq, Visitor&& visit) const;
+	template <typename QueryPointType>
+	size_t nearestIndex(const QueryPointType& target, size_t guess) const;
 	template <typename QueryPointType>
-	void findNearestRecursive(const Node* node, const QueryPointType& target, 
-		PointType& bestPoint, double& bestDistSq, size_t depth) const;
-	void destroyRecursive(Node* node);
-	Node* copyRecursive(const Node* other);
+	size_t leafOf(const QueryPointType& target) const;
 };
 
 template <typename PointType, size_t K>
-struct KDTree<PointType, K>::Node
+struct KDTree<PointType, K>::Range
 {
-	PointType point; // point stored in the node
-	Node* left; // coordinate smaller
-	Node* right; // coordinate larger
-	
-	Node(const PointType& p, Node* l = nullptr, Node* r = nullptr)
-		: point(p), left(l), right(r) {}
-	Node(PointType&& p, Node* l = nullptr, Node* r = nullptr)
-		: point(std::move(p)), left(l), right(r) {}
+	size_t begin;
+	size_t end;
+	size_t depth;
+	double planeDistSq; // lower bound of the distance to any point of the range
 };
 
 // constructors, destructor, assignements
-template <typename PointType, size_t K>
-inline KDTree<PointType, K>::KDTree() : m_root(nullptr), m_size(0) {}
-
 template<typename PointType, size_t K>
 inline KDTree<PointType, K>::KDTree(Array<PointType> points)
-	:m_root(nullptr), m_size(0)
+	: m_points(std::move(points))
 {
-	if (points.empty())
-		return;
-	m_size = points.size();
-	m_root = buildRecursive(points, 0, points.size(), 0);
+	build(0, m_points.size(), 0);
 }
 
 template<typename PointType, size_t K>
-inline KDTree<PointType, K>::KDTree(const KDTree& other)
-	: m_root(copyRecursive(other.m_root)), m_size(other.m_size) {}
-
-template<typename PointType, size_t K>
-inline KDTree<PointType, K>::KDTree(KDTree&& other) noexcept
-	: m_root(other.m_root), m_size(other.m_size)
+inline void KDTree<PointType, K>::swap(KDTree& other) noexcept
 {
-	other.m_root = nullptr;
-	other.m_size = 0;
+	std::swap(m_points, other.m_points);
 }
 
-template<typename PointType, size_t K>
-inline KDTree<PointType, K>::~KDTree()
-{
-	destroyRecursive(m_root);
-}
+// public methods
 
-template<typename PointType, size_t K>
-inline KDTree<PointType, K>& KDTree<PointType, K>::operator=(const KDTree<PointType, K>& other)
+template <typename PointType, size_t K>
+template <typename QueryPointType>
+inline PointType KDTree<PointType, K>::findNearest(const QueryPointType& target) const
 {
-	if (this != &other)
-	{
-		KDTree temp(other);
-		swap(temp);
-	}
-	return *this;
+	if (m_points.empty())
+		throw std::runtime_error("KDTree is empty, cannot find nearest point");
+	return m_points[nearestIndex(target, NONE)];
 }
 
-template<typename PointType, size_t K>
-inline KDTree<PointType, K>& KDTree<PointType, K>::operator=(KDTree<PointType, K>&& other) noexcept
+template <typename PointType, size_t K>
+template <typename QueryPointType>
+inline void KDTree<PointType, K>::findNearest(const Array<QueryPointType>& targets, Array<PointType>& nearest) const
 {
-	if (this != &other)
-	{
-		destroyRecursive(m_root); // clean current tree
-		m_root = other.m_root;
-		m_size = other.m_size;
-		other.m_root = nullptr;
-		other.m_size = 0;
-	}
-	return *this;
+	if (m_points.empty())
+		throw std::runtime_error("KDTree is empty, cannot find nearest point");
+	const size_t count = targets.size();
+	nearest.resize(count);
+	ThreadPool& pool = ThreadPool::instance();
+	Array<size_t> leaf(count);
+	pool.parallelFor(count, [&](size_t begin, size_t end)
+		{
+			for (size_t q = begin; q < end; q++)
+				leaf[q] = leafOf(targets[q]);
+		}, 1024);
+	Array<size_t> order(count);
+	for (size_t q = 0; q < count; q++)
+		order[q] = q;
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return leaf[a] < leaf[b]; });
+	pool.parallelFor(count, [&](size_t begin, size_t end)
+		{
+			size_t previous = NONE;
+			for (size_t k = begin; k < end; k++)
+			{
+				size_t q = order[k];
+				previous = nearestIndex(targets[q], previous);
+				nearest[q] = m_points[previous];
+			}
+		}, 256);
 }
 
-template<typename PointType, size_t K>
-inline void KDTree<PointType, K>::swap(KDTree& other) noexcept
+template <typename PointType, size_t K>
+template <typename QueryPointType>
+inline void KDTree<PointType, K>::findKNearest(const QueryPointType& target, size_t k, Array<PointType>& nearest) const
 {
-	std::swap(m_root, other.m_root);
-	std::swap(m_size, other.m_size);
+	nearest.clear();
+	k = std::min(k, m_points.size());
+	if (k == 0)
+		return;
+	// candidates sorted by (distance, index)
+	Array<std::pair<double, size_t>> best;
+	best.reserve(k + 1);
+	double boundSq = std::numeric_limits<double>::infinity();
+	search(target, boundSq, [&](size_t index, double distSq)
+		{
+			std::pair<double, size_t> candidate{ distSq, index };
+			if (best.size() == k && !(candidate < best.back()))
+				return;
+			if (best.size() == k)
+				best.popBack();
+			best.pushBack(candidate);
+			for (size_t i = best.size() - 1; i > 0 && best[i] < best[i - 1]; i--)
+				std::swap(best[i], best[i - 1]);
+			if (best.size() == k)
+				boundSq = best.back().first;
+		});
+	nearest.reserve(best.size());
+	for (const auto& candidate : best)
+		nearest.pushBack(m_points[candidate.second]);
 }
 
-// public methods
-
 template <typename PointType, size_t K>
 template <typename QueryPointType>
-inline PointType KDTree<PointType, K>::findNearest(const QueryPointType& target) const
+inline void KDTree<PointType, K>::findInRadius(const QueryPointType& target, double radius, Array<PointType>& found) const
 {
-	//static_assert(m_root, "Cannot find nearest in an empty KDTRee");
-	if (m_root == nullptr)
-		throw std::runtime_error("KDTree is empty, cannot find nearest point");
-	PointType bestPoint = m_root->point;
-	double bestDistSq = distSquared(target, bestPoint);
-	findNearestRecursive(m_root, target, bestPoint, bestDistSq, 0);
-	return bestPoint;
+	found.clear();
+	double boundSq = radius * radius;
+	search(target, boundSq, [&](size_t index, double distSq)
+		{
+			if (distSq <= boundSq)
+				found.pushBack(m_points[index]);
+		});
 }
 
 template<typename PointType, size_t K>
 inline bool KDTree<PointType, K>::empty() const noexcept
 {
-	return m_size == 0;
+	return m_points.empty();
 }
 
 template<typename PointType, size_t K>
 inline size_t KDTree<PointType, K>::size() const noexcept
 {
-	return m_size;
+	return m_points.size();
 }
 
 // private helper methods
 
 template<typename PointType, size_t K>
-inline typename KDTree<PointType, K>::Node* KDTree<PointType, K>::buildRecursive(Array<PointType>& points, size_t left, size_t right, size_t depth)
+inline void KDTree<PointType, K>::build(size_t begin, size_t end, size_t depth)
 {
-	// no points in this range
-	if(left >= right) 
-		return nullptr; 
+	// leaf bucket
+	if (end - begin <= LEAF_SIZE)
+		return;
 	size_t axis = depth % K; // splitting axis
-	size_t medianIdx = left + (right - left) / 2;
-	// partition subarray [left, right) around median element
-	std::nth_element(points.begin() + left, points.begin() + medianIdx,
-		points.begin() + right,
+	size_t medianIdx = begin + (end - begin) / 2;
+	// partition subarray [begin, end) around median element
+	std::nth_element(m_points.begin() + begin, m_points.begin() + medianIdx,
+		m_points.begin() + end,
 		[axis](const PointType& a, const PointType& b)
 		{return a[axis] < b[axis]; }
 		);
-	// create a new node with the median point
-	Node* node = new Node(points[medianIdx]);
-	//recursively
-	node->left = buildRecursive(points, left, medianIdx, depth + 1);
-	node->right = buildRecursive(points, medianIdx + 1, right, depth + 1);
-	return node;
+	build(begin, medianIdx, depth + 1);
+	build(medianIdx + 1, end, depth + 1);
 }
 
 template<typename PointType, size_t K>
-template <typename QueryPointType>
-inline void KDTree<PointType, K>::findNearestRecursive(const Node* node, const QueryPointType& target, PointType& bestPoint, double& bestDistSq, size_t depth) const
+template <typename QueryPointType, typename Visitor>
+inline void KDTree<PointType, K>::search(const QueryPointType& target, double& boundSq, Visitor&& visit) const
 {
-	if (node == nullptr)
+	if (m_points.empty())
 		return;
-	// squared distance from target to current nodes point
-	double currentDistSq = distSquared(target, node->point);
-	if (currentDistSq < bestDistSq)
+	StaticArray<Range, MAX_STACK> stack;
+	size_t top = 0;
+	stack[top++] = Range{ 0, m_points.size(), 0, 0.0 };
+	while (top > 0)
 	{
-		bestDistSq = currentDistSq;
-		bestPoint = node->point;
+		const Range range = stack[--top];
+		// the hypersphere around target does not reach this range
+		// (equal distances are still visited to resolve ties by index)
+		if (range.planeDistSq > boundSq)
+			continue;
+		if (range.end - range.begin <= LEAF_SIZE)
+		{
+			for (size_t i = range.begin; i < range.end; i++)
+				visit(i, distSquared(target, m_points[i]));
+			continue;
+		}
+		size_t medianIdx = range.begin + (range.end - range.begin) / 2;
+		visit(medianIdx, distSquared(target, m_points[medianIdx]));
+		size_t axis = range.depth % K;
+		// signed distance from target to the splitting hyperplane
+		double distToPlane = target[axis] - m_points[medianIdx][axis];
+		Range left{ range.begin, medianIdx, range.depth + 1, range.planeDistSq };
+		Range right{ medianIdx + 1, range.end, range.depth + 1, range.planeDistSq };
+		// far subtree is pushed first so the near one is visited first
+		if (distToPlane < 0)
+		{
+			right.planeDistSq = std::max(right.planeDistSq, distToPlane * distToPlane);
+			stack[top++] = right;
+			stack[top++] = left;
+		}
+		else
+		{
+			left.planeDistSq = std::max(left.planeDistSq, distToPlane * distToPlane);
+			stack[top++] = left;
+			stack[top++] = right;
+		}
 	}
-	size_t axis = depth % K;
-	// signed distance from target to splitting hyperplane 
-	// defined by node->point on current axis
-	double distToPlane = target[axis] - node->point[axis];
-	// near subtree containing target to visit first
-	Node* nearSubtree = (distToPlane < 0) ? node->left  : node->right;
-	Node* farSubtree  = (distToPlane < 0) ? node->right : node->left;
-
-	findNearestRecursive(nearSubtree, target, bestPoint, bestDistSq, depth + 1);
-	// if hypersphere around target with radius bestDist 
-	// itersects splitting hyperplane, farSubtree need to be visited too
-	if (distToPlane * distToPlane < bestDistSq)
-		findNearestRecursive(farSubtree, target, bestPoint, bestDistSq, depth + 1);
 }
 
 template<typename PointType, size_t K>
-inline void KDTree<PointType, K>::destroyRecursive(Node* node)
+template <typename QueryPointType>
+inline size_t KDTree<PointType, K>::nearestIndex(const QueryPointType& target, size_t guess) const
 {
-	if (node)
-	{
-		destroyRecursive(node->left);
-		destroyRecursive(node->right);
-		delete node;
-	}
+	// a nearby guess shrinks the search sphere from the start
+	size_t bestIdx = guess != NONE ? guess : leafOf(target);
+	double bestDistSq = distSquared(target, m_points[bestIdx]);
+	search(target, bestDistSq, [&](size_t index, double distSq)
+		{
+			if (distSq < bestDistSq || (distSq == bestDistSq && index < bestIdx))
+			{
+				bestDistSq = distSq;
+				bestIdx = index;
+			}
+		});
+	return bestIdx;
 }
 
 template<typename PointType, size_t K>
-inline typename KDTree<PointType, K>::Node* KDTree<PointType, K>::copyRecursive(const Node* otherNode)
+template <typename QueryPointType>
+inline size_t KDTree<PointType, K>::leafOf(const QueryPointType& target) const
 {
-	if (!otherNode)
-		return nullptr;
-	Node* newNode = new Node(otherNode->point);
-	newNode->left = copyRecursive(otherNode->left);
-	newNode->right = copyRecursive(otherNode->right);
-	return newNode;
-}
\ No newline at end of file
+	// descend without backtracking, returns the first point of the leaf bucket
+	size_t begin = 0;
+	size_t end = m_points.size();
+	size_t depth = 0;
+	while (end - begin > LEAF_SIZE)
+	{
+		size_t medianIdx = begin + (end - begin) / 2;
+		if (target[depth % K] < m_points[medianIdx][depth % K])
+			end = medianIdx;
+		else
+			begin = medianIdx + 1;
+		depth++;
+	}
+	return begin;
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include <algorithm>
+#include <cstdint>
 
 #include "data_structures/Array.hpp"
 #include "math/Vector.hpp"
@@ -13,7 +14,7 @@ private:
 	double m_dist; // mean distance from its neighbours
 public:
 	BoundaryPoint(const Point& p = { 0 }, double dist = 0.0) : Point(p), m_dist(dist) {}
-	double meanDist() { return m_dist; }
+	double meanDist() const { return m_dist; }
 };
 
 double distSquared(const Point& p, const Point& q)
@@ -26,6 +27,29 @@ double dist(const Point& p, const Point& q)
 	return norm(p - q);
 }
 
+// distance along the Hilbert curve filling a gridSize x gridSize grid (gridSize power of 2)
+inline uint32_t hilbertIndex(uint32_t x, uint32_t y, uint32_t gridSize)
+{
+	uint32_t d = 0;
+	for (uint32_t s = gridSize / 2; s > 0; s /= 2)
+	{
+		uint32_t rx = (x & s) > 0;
+		uint32_t ry = (y & s) > 0;
+		d += s * s * ((3 * rx) ^ ry);
+		// rotate the quadrant
+		if (ry == 0)
+		{
+			if (rx == 1)
+			{
+				x = s - 1 - x;
+				y = s - 1 - y;
+			}
+			std::swap(x, y);
+		}
+	}
+	return d;
+}
+
 bool pointInPolygon(const Point& p, const Array<Point>& polygon)
 {
 	// raycasting point in polygon test (ray in positive x direction)
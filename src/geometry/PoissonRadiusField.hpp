@@ -1,24 +1,32 @@
 #pragma once
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <limits>
 
 #include "data_structures/Array.hpp"
 #include "Point.hpp"
 #include "Boundaries.hpp"
-#include "KDTree.hpp"
+#include "tools/ThreadPool.hpp"
 
 class PoissonRadiusField
 {
 private:
 	enum class GridNodeType;
 private:
-	Array<Array<double>> m_radiusGrid;
-	Array<Array<GridNodeType>> m_nodeTypeGrid; // to identify "intirior" grid nodes for laplacian smoothing
+	// flat column-major N x M grids, node (i, j) at i * M + j
+	Array<double> m_radiusGrid;
+	Array<GridNodeType> m_nodeTypeGrid; // to identify "intirior" grid nodes for laplacian smoothing
+	size_t m_nodesX = 0;
+	size_t m_nodesY = 0;
 	AABB m_boundingBox;
 	double m_cellSize;
+	double m_maxRadius = 0.0;
 	double m_boundaryFactor = 1.5; // factor to determine if point is near boundary
 	double m_growthFactor = 0.08; // factor increasing radius away from the boundaries
 	double m_deepInteriorFactor = 5.0; // factor to determine if point is far away from boundaries
-	int m_smoothingIterations = 100;
+	int m_smoothingIterations = 100; // upper bound over all smoothing stages
+	double m_smoothingTolerance = 1e-4; // largest update relative to the largest radius
 public:
 	PoissonRadiusField(const Boundaries& boundaries);
 	~PoissonRadiusField() = default;
@@ -27,7 +35,11 @@ public:
 	PoissonRadiusField& operator=(const PoissonRadiusField&) = delete;
 	PoissonRadiusField& operator=(PoissonRadiusField&&) = delete;
 	double getRadius(const Point& p) const;
+	double maxRadius() const; // upper bound of getRadius over the domain
 private:
+	size_t nodeIndex(size_t i, size_t j) const;
+	void nearestBoundaryPoints(const Array<BoundaryPoint>& boundaryPoints, Array<BoundaryPoint>& nearest) const;
+	void insideNodes(const Boundaries& boundaries, Array<unsigned char>& inside) const;
 	void laplaceSmoothing(int iterations);
 };
 
@@ -49,15 +61,11 @@ PoissonRadiusField::PoissonRadiusField(const Boundaries& boundaries)
 	double ySize = m_boundingBox.yMax - yMin;
 	double scale = std::max(xSize, ySize);
 	// N x M grid - N in x direction, M in y direction
-	size_t N = std::ceil(xSize / m_cellSize) + 1;
-	size_t M = std::ceil(ySize / m_cellSize) + 1;
-	m_radiusGrid.resize(N);
-	for (auto& col : m_radiusGrid)
-		col.resize(M);
-	m_nodeTypeGrid.resize(N);
-	for (auto&& col : m_nodeTypeGrid)
-		col.resize(M);
-	// load boundary points into an arry to construct KDTree
+	m_nodesX = std::ceil(xSize / m_cellSize) + 1;
+	m_nodesY = std::ceil(ySize / m_cellSize) + 1;
+	m_radiusGrid = Array<double>(m_nodesX * m_nodesY);
+	m_nodeTypeGrid = Array<GridNodeType>(m_nodesX * m_nodesY);
+	// load boundary points into an arry with their spacing
 	Array<BoundaryPoint> boundaryPoints;
 	for (size_t i = 0; i < boundaries.getOuterBoundary().size(); i++)
 	{
@@ -75,47 +83,46 @@ PoissonRadiusField::PoissonRadiusField(const Boundaries& boundaries)
 			double meanNeighbourDist = 0.5 * (dist(inner[i], inner[iNext]) + dist(inner[i], inner[iPrev]));
 			boundaryPoints.pushBack(BoundaryPoint(inner[i], meanNeighbourDist));
 		}
-	KDTree<BoundaryPoint, 2> kdTree(boundaryPoints);
+	Array<BoundaryPoint> nearest;
+	nearestBoundaryPoints(boundaryPoints, nearest);
+	Array<unsigned char> inside;
+	insideNodes(boundaries, inside);
 	// fill the grid 
-	//// treshold to determine wheter grid node is boundary
-	//double boundaryThreshold = boundaries.minDist() * 3.0;
-	//// deep interior threshold to determine wheter grid node is far from boundaries
-	//double deepInteriorThreshold = boundaryThreshold * m_deepInteriorFactor;
-	for(size_t i = 0; i < N; i++)
-		for (size_t j = 0; j < M; j++)
+	ThreadPool::instance().parallelFor(m_nodesX, [&](size_t begin, size_t end)
 		{
-			double x = m_boundingBox.xMin + static_cast<double>(i) * m_cellSize;
-			double y = m_boundingBox.yMin + static_cast<double>(j) * m_cellSize;
-			Point gridPoint{ x, y };
-			BoundaryPoint nearest = kdTree.findNearest<Point>(gridPoint);
-			double boundaryRadius = nearest.meanDist();
-			double distanceToBoundary = dist(gridPoint, nearest);
-			m_radiusGrid[i][j] = boundaryRadius + scale * m_growthFactor * distanceToBoundary;
+			for (size_t i = begin; i < end; i++)
+				for (size_t j = 0; j < m_nodesY; j++)
+				{
+					size_t node = nodeIndex(i, j);
+					double x = xMin + static_cast<double>(i) * m_cellSize;
+					double y = yMin + static_cast<double>(j) * m_cellSize;
+					Point gridPoint{ x, y };
+					double boundaryRadius = nearest[node].meanDist();
+					double distanceToBoundary = dist(gridPoint, nearest[node]);
+					m_radiusGrid[node] = boundaryRadius + scale * m_growthFactor * distanceToBoundary;
 
-			// treshold to determine wheter grid node is boundary
-			double boundaryThreshold = nearest.meanDist() * m_boundaryFactor;
-			// deep interior threshold to determine wheter grid node is far from boundaries
-			double deepInteriorThreshold = boundaryThreshold * m_deepInteriorFactor;
+					// treshold to determine wheter grid node is boundary
+					double boundaryThreshold = boundaryRadius * m_boundaryFactor;
+					// deep interior threshold to determine wheter grid node is far from boundaries
+					double deepInteriorThreshold = boundaryThreshold * m_deepInteriorFactor;
 
-			if (boundaries.pointInBoundaries(gridPoint))
-			{
-				if (dist(gridPoint, nearest) < boundaryThreshold)
-				{
-					m_nodeTypeGrid[i][j] = GridNodeType::BOUNDARY;
-				}
-				else if (distanceToBoundary >= deepInteriorThreshold)
-				{
-					m_nodeTypeGrid[i][j] = GridNodeType::DEEP_INTERIOR;
-				}
-				else
-				{
-					m_nodeTypeGrid[i][j] = GridNodeType::INTERIOR;
+					if (inside[node])
+					{
+						if (distanceToBoundary < boundaryThreshold)
+							m_nodeTypeGrid[node] = GridNodeType::BOUNDARY;
+						else if (distanceToBoundary >= deepInteriorThreshold)
+							m_nodeTypeGrid[node] = GridNodeType::DEEP_INTERIOR;
+						else
+							m_nodeTypeGrid[node] = GridNodeType::INTERIOR;
+					}
+					else
+						m_nodeTypeGrid[node] = GridNodeType::EXTERIOR;
 				}
-			}
-			else
-				m_nodeTypeGrid[i][j] = GridNodeType::EXTERIOR;
-		}
+		}, 16);
 	laplaceSmoothing(m_smoothingIterations);
+	// bilinear interpolation never exceeds the largest node value
+	for (double radius : m_radiusGrid)
+		m_maxRadius = std::max(m_maxRadius, radius);
 }
 
 inline double PoissonRadiusField::getRadius(const Point& p) const
@@ -127,61 +134,249 @@ inline double PoissonRadiusField::getRadius(const Point& p) const
 	double gridCoordY = (p[1] - m_boundingBox.yMin) / m_cellSize;
 	size_t leftBottomI = static_cast<size_t>(std::floor(gridCoordX));
 	size_t leftBottomJ = static_cast<size_t>(std::floor(gridCoordY));
-	assert(leftBottomI >= 0 && leftBottomI + 1 < m_radiusGrid.size());
-	assert(leftBottomJ >= 0 && leftBottomJ + 1 < m_radiusGrid[leftBottomI].size());
+	assert(leftBottomI + 1 < m_nodesX);
+	assert(leftBottomJ + 1 < m_nodesY);
 	double fractionX = gridCoordX - leftBottomI;
 	double fractionY = gridCoordY - leftBottomJ;
+	const double* left = m_radiusGrid.data() + nodeIndex(leftBottomI, leftBottomJ);
+	const double* right = left + m_nodesY;
 	// bilinear interpolation
 	// y interpolations (left, right)
-	double left = m_radiusGrid[leftBottomI][leftBottomJ] * (1.0 - fractionY) + m_radiusGrid[leftBottomI][leftBottomJ + 1] * fractionY;
-	double right = m_radiusGrid[leftBottomI + 1][leftBottomJ] * (1.0 - fractionY) + m_radiusGrid[leftBottomI + 1][leftBottomJ + 1] * fractionY;
+	double leftValue = left[0] * (1.0 - fractionY) + left[1] * fractionY;
+	double rightValue = right[0] * (1.0 - fractionY) + right[1] * fractionY;
 	// x  interpolation
-	return left * (1.0 - fractionX) + right * fractionX;
+	return leftValue * (1.0 - fractionX) + rightValue * fractionX;
 
 }
 
-inline void PoissonRadiusField::laplaceSmoothing(int iterations)
+inline double PoissonRadiusField::maxRadius() const
 {
-	for(int it = 0; it < iterations; it++)
-		for(size_t i = 0; i < m_radiusGrid.size(); i++)
-			for (size_t j = 0; j < m_radiusGrid[i].size(); j++)
+	return m_maxRadius;
+}
+
+inline size_t PoissonRadiusField::nodeIndex(size_t i, size_t j) const
+{
+	return i * m_nodesY + j;
+}
+
+inline void PoissonRadiusField::nearestBoundaryPoints(const Array<BoundaryPoint>& boundaryPoints, Array<BoundaryPoint>& nearest) const
+{
+	// exact Euclidean distance transform (Felzenszwalb-Huttenlocher lower envelope of the point parabolas per grid column)
+	const double infinity = std::numeric_limits<double>::infinity();
+	nearest = Array<BoundaryPoint>(m_nodesX * m_nodesY);
+	const size_t n = boundaryPoints.size();
+	Array<size_t> byY(n);
+	for (size_t k = 0; k < n; k++)
+		byY[k] = k;
+	std::sort(byY.begin(), byY.end(), [&](size_t a, size_t b) { return boundaryPoints[a][1] < boundaryPoints[b][1]; });
+	ThreadPool::instance().parallelFor(m_nodesX, [&](size_t begin, size_t end)
+		{
+			// in column x the squared distance to point p is the parabola (y - p.y)^2 + (x - p.x)^2
+			Array<size_t> envelope(n); // points of the lower envelope by increasing root p.y
+			Array<double> breaks(n + 1); // envelope[k] is lowest for y in [breaks[k], breaks[k + 1])
+			Array<double> height(n);
+			for (size_t i = begin; i < end; i++)
 			{
-				if (m_nodeTypeGrid[i][j] != GridNodeType::INTERIOR)
-					continue;
-				int validNeighbourCount = 0;
-				double neighbourValueSum = 0.0;
-				// +1, -1 and so on for neighbours
-				// delta indices for 24 neighbours
-				int di[24] = { 1, -1, 0, 0, 1, 1, -1, -1, 2, -2, 0,  0, 4, -4, 0, 0, 8, -8, 0, 0, 16, -16, 0, 0};
-				int dj[24] = { 0, 0, 1, -1, 1, -1, 1, -1, 0,  0, 2, -2, 0, 0, 4, -4, 0, 0, 8, -8, 0, 0, 16, -16};
-				// initial iterations long range, then more local smoothing
-				int neighbours = 24;
-				if (it >= static_cast<int>(iterations * 0.4))
-					neighbours = 12;
-				if (it >= static_cast<int>(iterations * 0.8))
-					neighbours = 8;
-				for (int k = 0; k < neighbours; k++)
+				const double x = m_boundingBox.xMin + static_cast<double>(i) * m_cellSize;
+				for (size_t k = 0; k < n; k++)
 				{
-					long long niSigned = static_cast<long long>(i) + di[k];
-					long long njSigned = static_cast<long long>(j) + dj[k];
-					if (niSigned >= 0 && niSigned < m_radiusGrid.size() &&
-						njSigned >= 0 && njSigned < m_radiusGrid[i].size())
+					const double dx = x - boundaryPoints[k][0];
+					height[k] = dx * dx;
+				}
+				size_t count = 0;
+				for (size_t q : byY)
+				{
+					const double rootQ = boundaryPoints[q][1];
+					const double offsetQ = height[q] + rootQ * rootQ;
+					double s = -infinity;
+					bool dominated = false;
+					while (count > 0)
 					{
-						size_t ni = static_cast<size_t>(niSigned);
-						size_t nj = static_cast<size_t>(njSigned);
-						if (m_nodeTypeGrid[ni][nj] != GridNodeType::EXTERIOR)
+						const size_t top = envelope[count - 1];
+						const double rootTop = boundaryPoints[top][1];
+						if (rootQ == rootTop)
 						{
-							validNeighbourCount++;
-							neighbourValueSum += m_radiusGrid[ni][nj];
+							// equal roots - the lower parabola is below everywhere
+							if (height[q] >= height[top])
+							{
+								dominated = true;
+								break;
+							}
+							count--;
+							continue;
 						}
+						s = (offsetQ - (height[top] + rootTop * rootTop)) / (2.0 * (rootQ - rootTop));
+						if (s > breaks[count - 1])
+							break;
+						count--;
 					}
-					else
+					if (dominated)
+						continue;
+					if (count == 0)
+						s = -infinity;
+					envelope[count] = q;
+					breaks[count] = s;
+					count++;
+				}
+				breaks[count] = infinity;
+				size_t k = 0;
+				for (size_t j = 0; j < m_nodesY; j++)
+				{
+					const double y = m_boundingBox.yMin + static_cast<double>(j) * m_cellSize;
+					while (breaks[k + 1] < y)
+						k++;
+					nearest[nodeIndex(i, j)] = boundaryPoints[envelope[k]];
+				}
+			}
+		}, 4);
+}
+
+inline void PoissonRadiusField::insideNodes(const Boundaries& boundaries, Array<unsigned char>& inside) const
+{
+	// scanline fill: every grid row y = const collects the x coordinates where polygon
+	// edges cross it, a node is inside after an odd number of crossings at or left of it
+	const double yMin = m_boundingBox.yMin;
+	auto rowRange = [&](const Point& a, const Point& b, size_t& begin, size_t& end)
+		{
+			// rows with y in (min(a, b), max(a, b)], the half-open convention of pointInBoundaries
+			double low = std::min(a[1], b[1]);
+			double high = std::max(a[1], b[1]);
+			begin = static_cast<size_t>(std::max(0.0, std::floor((low - yMin) / m_cellSize)));
+			end = static_cast<size_t>(std::max(0.0, std::floor((high - yMin) / m_cellSize))) + 1;
+			while (begin < end && yMin + static_cast<double>(begin) * m_cellSize <= low)
+				begin++;
+			while (end > begin && yMin + static_cast<double>(end - 1) * m_cellSize > high)
+				end--;
+			end = std::min(end, m_nodesY);
+		};
+	auto forEachEdge = [&](auto&& function)
+		{
+			auto polygon = [&](const Array<Point>& loop)
+				{
+					for (size_t k = 0; k < loop.size(); k++)
+						function(loop[k], loop[(k + 1) % loop.size()]);
+				};
+			polygon(boundaries.getOuterBoundary());
+			for (const auto& inner : boundaries.getInnerBoundaries())
+				polygon(inner);
+		};
+	// crossings bucketed by row (CSR)
+	Array<size_t> rowPtr(m_nodesY + 1, 0);
+	forEachEdge([&](const Point& a, const Point& b)
+		{
+			size_t begin, end;
+			rowRange(a, b, begin, end);
+			for (size_t j = begin; j < end; j++)
+				rowPtr[j + 1]++;
+		});
+	for (size_t j = 0; j < m_nodesY; j++)
+		rowPtr[j + 1] += rowPtr[j];
+	Array<double> crossings(rowPtr[m_nodesY]);
+	Array<size_t> fill(rowPtr);
+	forEachEdge([&](const Point& a, const Point& b)
+		{
+			size_t begin, end;
+			rowRange(a, b, begin, end);
+			for (size_t j = begin; j < end; j++)
+			{
+				const Point& low = a[1] < b[1] ? a : b;
+				const Point& high = a[1] < b[1] ? b : a;
+				double y = yMin + static_cast<double>(j) * m_cellSize;
+				crossings[fill[j]++] = low[0] + (y - low[1]) * (high[0] - low[0]) / (high[1] - low[1]);
+			}
+		});
+	inside = Array<unsigned char>(m_nodesX * m_nodesY, 0);
+	ThreadPool::instance().parallelFor(m_nodesY, [&](size_t begin, size_t end)
+		{
+			for (size_t j = begin; j < end; j++)
+			{
+				double* first = crossings.data() + rowPtr[j];
+				double* last = crossings.data() + rowPtr[j + 1];
+				std::sort(first, last);
+				bool in = false;
+				for (size_t i = 0; i < m_nodesX; i++)
+				{
+					double x = m_boundingBox.xMin + static_cast<double>(i) * m_cellSize;
+					while (first != last && *first <= x)
 					{
-						validNeighbourCount++;
-						neighbourValueSum += m_radiusGrid[i][j];
+						in = !in;
+						first++;
 					}
+					inside[nodeIndex(i, j)] = in;
 				}
-				if (validNeighbourCount > 0)
-					m_radiusGrid[i][j] = neighbourValueSum / static_cast<double>(validNeighbourCount);
 			}
+		}, 16);
+}
+
+inline void PoissonRadiusField::laplaceSmoothing(int iterations)
+{
+	// Jacobi iterations with long range stencils first, then more local smoothing
+	// each stage stops once the largest update is below the tolerance
+	// delta indices for 24 neighbours
+	static const int di[24] = { 1, -1, 0, 0, 1, 1, -1, -1, 2, -2, 0,  0, 4, -4, 0, 0, 8, -8, 0, 0, 16, -16, 0, 0};
+	static const int dj[24] = { 0, 0, 1, -1, 1, -1, 1, -1, 0,  0, 2, -2, 0, 0, 4, -4, 0, 0, 8, -8, 0, 0, 16, -16};
+	const int stageNeighbours[3] = { 24, 12, 8 };
+	const int stageIterations[3] = { static_cast<int>(iterations * 0.4),
+		static_cast<int>(iterations * 0.8) - static_cast<int>(iterations * 0.4),
+		iterations - static_cast<int>(iterations * 0.8) };
+	double largest = 0.0;
+	for (double radius : m_radiusGrid)
+		largest = std::max(largest, radius);
+	const double tolerance = m_smoothingTolerance * largest;
+	Array<double> next(m_radiusGrid);
+	Array<double> columnChange(m_nodesX);
+	ThreadPool& pool = ThreadPool::instance();
+	for (int stage = 0; stage < 3; stage++)
+	{
+		const int neighbours = stageNeighbours[stage];
+		for (int it = 0; it < stageIterations[stage]; it++)
+		{
+			pool.parallelFor(m_nodesX, [&](size_t begin, size_t end)
+				{
+					for (size_t i = begin; i < end; i++)
+					{
+						double change = 0.0; // every column is written, also without INTERIOR nodes
+						for (size_t j = 0; j < m_nodesY; j++)
+						{
+							size_t node = nodeIndex(i, j);
+							if (m_nodeTypeGrid[node] != GridNodeType::INTERIOR)
+								continue;
+							int validNeighbourCount = 0;
+							double neighbourValueSum = 0.0;
+							for (int k = 0; k < neighbours; k++)
+							{
+								long long niSigned = static_cast<long long>(i) + di[k];
+								long long njSigned = static_cast<long long>(j) + dj[k];
+								if (niSigned >= 0 && niSigned < static_cast<long long>(m_nodesX) &&
+									njSigned >= 0 && njSigned < static_cast<long long>(m_nodesY))
+								{
+									size_t neighbour = nodeIndex(niSigned, njSigned);
+									if (m_nodeTypeGrid[neighbour] != GridNodeType::EXTERIOR)
+									{
+										validNeighbourCount++;
+										neighbourValueSum += m_radiusGrid[neighbour];
+									}
+								}
+								else
+								{
+									validNeighbourCount++;
+									neighbourValueSum += m_radiusGrid[node];
+								}
+							}
+							if (validNeighbourCount > 0)
+							{
+								next[node] = neighbourValueSum / static_cast<double>(validNeighbourCount);
+								change = std::max(change, std::abs(next[node] - m_radiusGrid[node]));
+							}
+						}
+						columnChange[i] = change;
+					}
+				}, 16);
+			std::swap(m_radiusGrid, next);
+			if (*std::max_element(columnChange.begin(), columnChange.end()) <= tolerance)
+				break;
+		}
+		// both buffers agree again before the next stage
+		next = m_radiusGrid;
+	}
 }
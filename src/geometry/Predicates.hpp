@@ -0,0 +1,255 @@
+#pragma once
+#include <cmath>
+#include <limits>
+#include "Point.hpp"
+
+// robust geometric predicates (after J. R. Shewchuk, "Adaptive Precision Floating-Point
+// Arithmetic and Fast Robust Geometric Predicates")
+// plain double evaluation is accepted whenever a static error bound proves its sign,
+// otherwise the determinant is evaluated exactly with floating-point expansions
+
+namespace predicates
+{
+// --- expansion arithmetic ---
+// an expansion is a sum of nonoverlapping doubles stored in increasing magnitude
+
+constexpr double EPSILON = std::numeric_limits<double>::epsilon() / 2.0; // 2^-53
+constexpr double SPLITTER = 134217729.0; // 2^27 + 1
+constexpr double CCW_ERROR_BOUND = (3.0 + 16.0 * EPSILON) * EPSILON;
+constexpr double INCIRCLE_ERROR_BOUND = (10.0 + 96.0 * EPSILON) * EPSILON;
+
+// x + y == a + b exactly
+inline void twoSum(double a, double b, double& x, double& y)
+{
+	x = a + b;
+	double bVirtual = x - a;
+	double aVirtual = x - bVirtual;
+	y = (a - aVirtual) + (b - bVirtual);
+}
+
+// x + y == a - b exactly
+inline void twoDiff(double a, double b, double& x, double& y)
+{
+	x = a - b;
+	double bVirtual = a - x;
+	double aVirtual = x + bVirtual;
+	y = (a - aVirtual) + (bVirtual - b);
+}
+
+// a == hi + lo, both halves with at most 26 significant bits
+inline void split(double a, double& hi, double& lo)
+{
+	double c = SPLITTER * a;
+	double aBig = c - a;
+	hi = c - aBig;
+	lo = a - hi;
+}
+
+// x + y == a * b exactly
+inline void twoProduct(double a, double b, double& x, double& y)
+{
+	x = a * b;
+	double aHi, aLo, bHi, bLo;
+	split(a, aHi, aLo);
+	split(b, bHi, bLo);
+	double err1 = x - aHi * bHi;
+	double err2 = err1 - aLo * bHi;
+	double err3 = err2 - aHi * bLo;
+	y = aLo * bLo - err3;
+}
+
+// h = e + f, returns the length of h (zero components eliminated)
+inline int expansionSum(int eLength, const double* e, int fLength, const double* f, double* h)
+{
+	int length = 0;
+	int ei = 0;
+	int fi = 0;
+	double q = 0.0;
+	double sum, err;
+	// merge by magnitude
+	auto takeSmaller = [&]()
+		{
+			if (fi >= fLength || (ei < eLength && std::abs(e[ei]) < std::abs(f[fi])))
+				return e[ei++];
+			return f[fi++];
+		};
+	if (eLength + fLength == 0)
+		return 0;
+	q = takeSmaller();
+	while (ei < eLength || fi < fLength)
+	{
+		twoSum(q, takeSmaller(), sum, err);
+		q = sum;
+		if (err != 0.0)
+			h[length++] = err;
+	}
+	if (q != 0.0 || length == 0)
+		h[length++] = q;
+	return length;
+}
+
+// h = b * e, returns the length of h (zero components eliminated)
+inline int scaleExpansion(int eLength, const double* e, double b, double* h)
+{
+	int length = 0;
+	double q, sum, err, productHi, productLo;
+	twoProduct(e[0], b, q, err);
+	if (err != 0.0)
+		h[length++] = err;
+	for (int i = 1; i < eLength; i++)
+	{
+		twoProduct(e[i], b, productHi, productLo);
+		twoSum(q, productLo, sum, err);
+		if (err != 0.0)
+			h[length++] = err;
+		twoSum(productHi, sum, q, err);
+		if (err != 0.0)
+			h[length++] = err;
+	}
+	if (q != 0.0 || length == 0)
+		h[length++] = q;
+	return length;
+}
+
+// h = e * f, scratch must hold 4 * eLength * fLength values, h 2 * eLength * fLength
+inline int multiplyExpansions(int eLength, const double* e, int fLength, const double* f, double* h, double* scratch)
+{
+	double* scaled = scratch;
+	double* sum = scratch + 2 * eLength;
+	int length = 0;
+	for (int i = 0; i < fLength; i++)
+	{
+		int scaledLength = scaleExpansion(eLength, e, f[i], scaled);
+		length = expansionSum(length, h, scaledLength, scaled, sum);
+		for (int k = 0; k < length; k++)
+			h[k] = sum[k];
+	}
+	return length;
+}
+
+// --- exact determinants ---
+
+inline double orient2dExact(const Point& a, const Point& b, const Point& c)
+{
+	// (ax - cx) * (by - cy) - (ay - cy) * (bx - cx) with exact differences
+	double acx[2], bcy[2], acy[2], bcx[2];
+	twoDiff(a[0], c[0], acx[1], acx[0]);
+	twoDiff(b[1], c[1], bcy[1], bcy[0]);
+	twoDiff(a[1], c[1], acy[1], acy[0]);
+	twoDiff(b[0], c[0], bcx[1], bcx[0]);
+	double left[8], right[8], scratch[16], det[16];
+	int leftLength = multiplyExpansions(2, acx, 2, bcy, left, scratch);
+	int rightLength = multiplyExpansions(2, acy, 2, bcx, right, scratch);
+	for (int i = 0; i < rightLength; i++)
+		right[i] = -right[i];
+	int length = expansionSum(leftLength, left, rightLength, right, det);
+	return det[length - 1];
+}
+
+inline double incircleExact(const Point& a, const Point& b, const Point& c, const Point& d)
+{
+	// rows relative to d, all differences kept exactly as two-component expansions
+	double adx[2], ady[2], bdx[2], bdy[2], cdx[2], cdy[2];
+	twoDiff(a[0], d[0], adx[1], adx[0]);
+	twoDiff(a[1], d[1], ady[1], ady[0]);
+	twoDiff(b[0], d[0], bdx[1], bdx[0]);
+	twoDiff(b[1], d[1], bdy[1], bdy[0]);
+	twoDiff(c[0], d[0], cdx[1], cdx[0]);
+	twoDiff(c[1], d[1], cdy[1], cdy[0]);
+	double scratch[1024];
+	// |x|^2 of a row
+	auto lift = [&](const double* x, const double* y, double* out)
+		{
+			double xx[8], yy[8];
+			int xxLength = multiplyExpansions(2, x, 2, x, xx, scratch);
+			int yyLength = multiplyExpansions(2, y, 2, y, yy, scratch);
+			return expansionSum(xxLength, xx, yyLength, yy, out);
+		};
+	// 2x2 minor x1 * y2 - x2 * y1
+	auto minor = [&](const double* x1, const double* y2, const double* x2, const double* y1, double* out)
+		{
+			double left[8], right[8];
+			int leftLength = multiplyExpansions(2, x1, 2, y2, left, scratch);
+			int rightLength = multiplyExpansions(2, x2, 2, y1, right, scratch);
+			for (int i = 0; i < rightLength; i++)
+				right[i] = -right[i];
+			return expansionSum(leftLength, left, rightLength, right, out);
+		};
+	double aLift[16], bLift[16], cLift[16];
+	double bcMinor[16], caMinor[16], abMinor[16];
+	int aLiftLength = lift(adx, ady, aLift);
+	int bLiftLength = lift(bdx, bdy, bLift);
+	int cLiftLength = lift(cdx, cdy, cLift);
+	int bcLength = minor(bdx, cdy, cdx, bdy, bcMinor);
+	int caLength = minor(cdx, ady, adx, cdy, caMinor);
+	int abLength = minor(adx, bdy, bdx, ady, abMinor);
+	double aTerm[512], bTerm[512], cTerm[512], abSum[1024], det[1536];
+	int aTermLength = multiplyExpansions(aLiftLength, aLift, bcLength, bcMinor, aTerm, scratch);
+	int bTermLength = multiplyExpansions(bLiftLength, bLift, caLength, caMinor, bTerm, scratch);
+	int cTermLength = multiplyExpansions(cLiftLength, cLift, abLength, abMinor, cTerm, scratch);
+	int abSumLength = expansionSum(aTermLength, aTerm, bTermLength, bTerm, abSum);
+	int length = expansionSum(abSumLength, abSum, cTermLength, cTerm, det);
+	return det[length - 1];
+}
+}
+
+// positive if a, b, c are in counterclockwise order, negative if clockwise, zero if collinear
+// (the magnitude is twice the signed area unless the exact path was needed)
+inline double orient2d(const Point& a, const Point& b, const Point& c)
+{
+	double detLeft = (a[0] - c[0]) * (b[1] - c[1]);
+	double detRight = (a[1] - c[1]) * (b[0] - c[0]);
+	double det = detLeft - detRight;
+	double detSum;
+	if (detLeft > 0.0)
+	{
+		if (detRight <= 0.0)
+			return det;
+		detSum = detLeft + detRight;
+	}
+	else if (detLeft < 0.0)
+	{
+		if (detRight >= 0.0)
+			return det;
+		detSum = -detLeft - detRight;
+	}
+	else
+		return det;
+	double errorBound = predicates::CCW_ERROR_BOUND * detSum;
+	if (det >= errorBound || -det >= errorBound)
+		return det;
+	return predicates::orient2dExact(a, b, c);
+}
+
+// positive if d lies inside the circle through counterclockwise a, b, c,
+// negative if outside, zero if the four points are cocircular
+inline double incircle(const Point& a, const Point& b, const Point& c, const Point& d)
+{
+	double adx = a[0] - d[0];
+	double bdx = b[0] - d[0];
+	double cdx = c[0] - d[0];
+	double ady = a[1] - d[1];
+	double bdy = b[1] - d[1];
+	double cdy = c[1] - d[1];
+
+	double bdxcdy = bdx * cdy;
+	double cdxbdy = cdx * bdy;
+	double aLift = adx * adx + ady * ady;
+
+	double cdxady = cdx * ady;
+	double adxcdy = adx * cdy;
+	double bLift = bdx * bdx + bdy * bdy;
+
+	double adxbdy = adx * bdy;
+	double bdxady = bdx * ady;
+	double cLift = cdx * cdx + cdy * cdy;
+
+	double det = aLift * (bdxcdy - cdxbdy) + bLift * (cdxady - adxcdy) + cLift * (adxbdy - bdxady);
+	double permanent = (std::abs(bdxcdy) + std::abs(cdxbdy)) * aLift
+		+ (std::abs(cdxady) + std::abs(adxcdy)) * bLift
+		+ (std::abs(adxbdy) + std::abs(bdxady)) * cLift;
+	double errorBound = predicates::INCIRCLE_ERROR_BOUND * permanent;
+	if (det > errorBound || -det > errorBound)
+		return det;
+	return predicates::incircleExact(a, b, c, d);
+}
@@ -1,10 +1,14 @@
 #pragma once
 #include <cassert>
+#include <cmath>
 #include "data_structures/List.hpp"
 #include "data_structures/Array.hpp"
 #include "data_structures/Map.hpp"
+#include "data_structures/Allocator.hpp"
 #include "Point.hpp"
+#include "Predicates.hpp"
 #include "Boundaries.hpp"
+#include "tools/Random.hpp"
 
 class Triangulation
 {
@@ -44,9 +48,13 @@ private:
 	Array<Vertex> m_vertices;
 	Array<HalfEdge> m_halfEdges;
 	Array<Face> m_faces;
-	List<size_t> m_activeFaces;
+	Array<size_t> m_activeFaces; // unordered, faces know their position
+	size_t m_lastFace = INVALID_IDX; // most recently created face, start of point location
+	size_t m_walkStepBudget = 64; // walk steps from m_lastFace before jumping
+	std::mt19937 m_engine; // BRIO rounds and jump samples, default seeded so the mesh of a point set is the same on every run
 	List<size_t> m_freeFaces;
 	List<size_t> m_freeHalfEdges;
+	MonotonicArena m_arena; // scratch memory of a single vertex insertion
 	Point m_superPoints[3]; // for initial super triangle
 	Array<Point> m_trianglePoints;
 	int m_smoothingIterations = 50;
@@ -62,7 +70,12 @@ public:
 	int getVertexBoundaryId(size_t i) const;
 	size_t vertexCount() const;
 	StaticArray<size_t, 3> getTriangleVertexIndices(size_t i) const;
+	// half-edges of a triangle, the k-th one goes from vertex k to vertex k + 1
+	StaticArray<size_t, 3> getTriangleHalfEdgeIndices(size_t i) const;
 	size_t getTriangleCount() const;
+	size_t halfEdgeCount() const;
+	size_t getHalfEdgeTwin(size_t i) const; // INVALID_IDX if there is none
+	bool isBoundaryHalfEdge(size_t i) const; // boundary segment or edge of a single triangle
 private:
 	// --- half-edge accessors ---
 	//  - top-level accessors (get element by its handle) -
@@ -96,15 +109,23 @@ private:
 	void setAdjacentHalfEdge(FaceHandle faceHandle, HalfEdgeHandle heHandle);
 private:
 	void initializeWithSuperTriangle(const Boundaries& boundaries);
-	void addVertex(Point* point);
-	void removeExteriorTriangles(const Boundaries& boundaries);
+	Array<size_t> insertionOrder(const Array<Point*>& points);
+	size_t addVertex(Point* point); // index of the vertex at the point, an existing one for a duplicate
+	size_t locateFace(const Point& point);
+	bool walk(size_t& faceIdx, const Point& point, size_t maxSteps); // false if not done within maxSteps
+	VertexHandle coincidentVertex(size_t faceIdx, const Point& point); // vertex of the face at the point
+	void insertConstraint(VertexHandle from, VertexHandle to);
+	HalfEdgeHandle findEdge(VertexHandle from, VertexHandle to);
+	bool flipEdge(HalfEdgeHandle handle);
+	void removeExteriorTriangles();
 	void laplaceSmoothing(int iterations);
 	VertexAccessor pushVertex();
 	HalfEdgeAccessor pushHalfEdge();
 	FaceAccessor pushFace();
 	void removeWholeEdge(HalfEdgeHandle halfEdge);
 	void removeFace(size_t activeFaceIdx);
-	void removeFaces(const List<size_t>& faceIndices);
+	template <typename Allocator>
+	void removeFaces(const Array<size_t, Allocator>& faceIndices);
 	void makeCompact();
 };
 
@@ -153,8 +174,9 @@ struct Triangulation::HalfEdge
 	size_t twin = INVALID_IDX; // oppositely oriented half-edge
 	size_t next = INVALID_IDX; // next in face loop
 	size_t adjacentFace = INVALID_IDX; // face on the left of the HE (anti-clockwise orientation)
+	bool constrained = false; // boundary segment, never flipped
 	// reset method
-	void reset() { origin = twin = next = adjacentFace = INVALID_IDX; }
+	void reset() { origin = twin = next = adjacentFace = INVALID_IDX; constrained = false; }
 };
 
 
@@ -183,8 +205,11 @@ private:
 struct Triangulation::Face
 {
 	size_t adjacentHalfEdge = INVALID_IDX; // one of the half-edges
+	size_t activePosition = INVALID_IDX; // index in m_activeFaces
+	size_t visitedBy = INVALID_IDX; // vertex whose cavity search last visited the face
+	bool inCavity = false; // valid only together with visitedBy
 	// reset method
-	void reset() { adjacentHalfEdge = INVALID_IDX; }
+	void reset() { adjacentHalfEdge = activePosition = visitedBy = INVALID_IDX; inCavity = false; }
 };
 
 
@@ -392,25 +417,52 @@ Triangulation::Triangulation(const Boundaries& boundaries, Array<Point>& innerPo
 		m_freeHalfEdges.pushBack(i);
 	initializeWithSuperTriangle(boundaries);
 		
+	// collect all points with their boundary ids
+	Array<Point*> points;
+	Array<int> boundaryIds;
+	points.reserve(vertexCount - 3);
+	boundaryIds.reserve(vertexCount - 3);
 	for (auto& point : boundaries.getOuterBoundary())
 	{
-		addVertex(const_cast<Point*>(&point));
-		m_vertices.back().boundaryId = 0;
+		points.pushBack(const_cast<Point*>(&point));
+		boundaryIds.pushBack(0);
 	}
 	for (size_t i = 0; i < boundaries.getInnerBoundaries().size(); i++)
 	{
 		for (auto& point : (boundaries.getInnerBoundaries())[i])
 		{
-			addVertex(const_cast<Point*>(&point));
-			m_vertices.back().boundaryId = i + 1; // 0 for outer boiundary
+			points.pushBack(const_cast<Point*>(&point));
+			boundaryIds.pushBack(static_cast<int>(i + 1)); // 0 for outer boiundary
 		}
 	}
 	for (auto& point : innerPoints)
 	{
-		addVertex(&point);
-		m_vertices.back().boundaryId = -1;
+		points.pushBack(&point);
+		boundaryIds.pushBack(-1);
 	}
-	removeExteriorTriangles(boundaries);
+	// insert in spatially coherent order
+	Array<size_t> pointToVertex(points.size());
+	for (size_t idx : insertionOrder(points))
+	{
+		size_t vertex = addVertex(points[idx]);
+		// a merged duplicate keeps a boundary id over the interior one
+		if (m_vertices[vertex].boundaryId < 0)
+			m_vertices[vertex].boundaryId = boundaryIds[idx];
+		pointToVertex[idx] = vertex;
+	}
+	// recover boundary segments (boundary points come first in points, polygon by polygon)
+	size_t loopStart = 0;
+	auto constrainLoop = [&](size_t loopSize)
+		{
+			for (size_t i = 0; i < loopSize; i++)
+				if (pointToVertex[loopStart + i] != pointToVertex[loopStart + (i + 1) % loopSize]) // merged duplicates
+					insertConstraint({ pointToVertex[loopStart + i] }, { pointToVertex[loopStart + (i + 1) % loopSize] });
+			loopStart += loopSize;
+		};
+	constrainLoop(boundaries.getOuterBoundary().size());
+	for (const auto& inner : boundaries.getInnerBoundaries())
+		constrainLoop(inner.size());
+	removeExteriorTriangles();
 
 	// cleanup
 	makeCompact();
@@ -501,29 +553,89 @@ inline void Triangulation::initializeWithSuperTriangle(const Boundaries& boundar
 	he10.setAdjacentFace(INVALID_FACE_HANDLE);
 }
 
-inline void Triangulation::addVertex(Point* point)
+inline Array<size_t> Triangulation::insertionOrder(const Array<Point*>& points)
+{
+	// biased randomized insertion order (BRIO) - random rounds of doubling size,
+	// each round sorted along a Hilbert curve
+	const size_t n = points.size();
+	if (n == 0)
+		return {};
+	AABB box{ (*points[0])[0], (*points[0])[0], (*points[0])[1], (*points[0])[1] };
+	for (const Point* p : points)
+	{
+		box.xMin = std::min(box.xMin, (*p)[0]);
+		box.xMax = std::max(box.xMax, (*p)[0]);
+		box.yMin = std::min(box.yMin, (*p)[1]);
+		box.yMax = std::max(box.yMax, (*p)[1]);
+	}
+	constexpr uint32_t gridSize = 1u << 16;
+	const double scale = (gridSize - 1) / std::max({ box.xMax - box.xMin, box.yMax - box.yMin, 1e-300 });
+	// round 0 holds about one point, the last round about half of them
+	uint32_t roundCount = 1;
+	while ((size_t{ 1 } << roundCount) < n)
+		roundCount++;
+	Array<uint64_t> keys(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		uint32_t level = 0;
+		while (level < roundCount && Random::get<int>(0, 1, m_engine) == 1)
+			level++;
+		uint64_t round = roundCount - level;
+		uint32_t x = static_cast<uint32_t>(((*points[i])[0] - box.xMin) * scale);
+		uint32_t y = static_cast<uint32_t>(((*points[i])[1] - box.yMin) * scale);
+		keys[i] = (round << 32) | hilbertIndex(x, y, gridSize);
+	}
+	Array<size_t> order(n);
+	for (size_t i = 0; i < n; i++)
+		order[i] = i;
+	std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return keys[a] < keys[b]; });
+	return order;
+}
+
+inline size_t Triangulation::addVertex(Point* point)
 {
+	size_t containingFace = locateFace(*point);
+	// a point coinciding with an existing vertex is merged into it - it lies on the circumcircle
+	// of every face around the vertex, so it has no cavity and would only give zero-area triangles
+	VertexHandle coincident = coincidentVertex(containingFace, *point);
+	if (coincident != INVALID_VERTEX_HANDLE)
+		return coincident.idx;
 	VertexAccessor newVertex = pushVertex();
 	newVertex.setPoint(point);
 	newVertex.setLeaving(INVALID_HALFEDGE_HANDLE); // will be set during retriangulation
-	// find bad triangles
-	List<size_t> badTriangleIndices;
-	for (const auto& faceIdx : m_activeFaces)
-		if (isInCircumcircle(getFace({faceIdx}), *point))
+	const size_t stamp = newVertex.handle().idx;
+	// temporary arrays live in the arena, released when the insertion is done
+	ArenaScope scratch(m_arena);
+	const ArenaAllocator<size_t> arena(m_arena);
+	// find bad triangles - breadth first search across twins from the face containing the point
+	// (the bad triangles of a Delaunay triangulation form a connected cavity around it)
+	Array<size_t, ArenaAllocator<size_t>> badTriangleIndices(arena);
+	assert(isInCircumcircle(getFace({ containingFace }), *point));
+	m_faces[containingFace].visitedBy = stamp;
+	m_faces[containingFace].inCavity = true;
+	badTriangleIndices.pushBack(containingFace);
+	for (size_t i = 0; i < badTriangleIndices.size(); i++)
+	{
+		HalfEdgeAccessor currentHE = getFace({ badTriangleIndices[i] }).adjacentHalfEdge();
+		for (int k = 0; k < 3; k++, currentHE = currentHE.next())
 		{
-			badTriangleIndices.pushBack(faceIdx);
+			FaceHandle neighbor = currentHE.twin().adjacentFace().handle();
+			if (neighbor == INVALID_FACE_HANDLE || m_faces[neighbor.idx].visitedBy == stamp)
+				continue;
+			m_faces[neighbor.idx].visitedBy = stamp;
+			m_faces[neighbor.idx].inCavity = isInCircumcircle(getFace(neighbor), *point);
+			if (m_faces[neighbor.idx].inCavity)
+				badTriangleIndices.pushBack(neighbor.idx);
 		}
-	assert(!badTriangleIndices.empty());
+	}
 	//helper function to check if traingle is bad by index
 	auto isTriangleBad = [&](size_t idx) 
 		{
-			for (const auto& badIdx : badTriangleIndices)  
-				if (idx == badIdx) return true; 
-			return false; 
+			return m_faces[idx].visitedBy == stamp && m_faces[idx].inCavity;
 		};
 	// find all bad edges and hole boundary edges
-	List<HalfEdgeHandle> cavityPolygonHE;
-	List<HalfEdgeHandle> cavityInternalHE;
+	Array<HalfEdgeHandle, ArenaAllocator<HalfEdgeHandle>> cavityPolygonHE(arena);
+	Array<HalfEdgeHandle, ArenaAllocator<HalfEdgeHandle>> cavityInternalHE(arena);
 	for (const auto& badIdx : badTriangleIndices)
 	{
 		auto  badTriangle = getFace({ badIdx });
@@ -551,7 +663,8 @@ inline void Triangulation::addVertex(Point* point)
 	// check if at least 3 hole half-edges
 	assert(cavityPolygonHE.size() >= 3);
 	// create ordered (CCW) list of hole half-edges
-	List<HalfEdgeHandle> orderedCavityPolygonHE;
+	Array<HalfEdgeHandle, ArenaAllocator<HalfEdgeHandle>> orderedCavityPolygonHE(arena);
+	orderedCavityPolygonHE.reserve(cavityPolygonHE.size());
 	orderedCavityPolygonHE.pushBack(cavityPolygonHE.front());
 	while (orderedCavityPolygonHE.size() != cavityPolygonHE.size())
 	{
@@ -595,13 +708,10 @@ inline void Triangulation::addVertex(Point* point)
 		assert(he.next().next().origin().handle() != INVALID_VERTEX_HANDLE);
 	}
 	// link twins
-	for (List<HalfEdgeHandle>::Iterator heIt = orderedCavityPolygonHE.begin(); heIt != orderedCavityPolygonHE.end(); )
+	for (size_t i = 0; i < orderedCavityPolygonHE.size(); i++)
 	{
-		HalfEdgeAccessor current{ this, *heIt };
-		auto nextIterator = ++heIt;
-		if (nextIterator == orderedCavityPolygonHE.end())
-			nextIterator = orderedCavityPolygonHE.begin();
-		HalfEdgeAccessor nextInCavity{ this, *nextIterator };
+		HalfEdgeAccessor current{ this, orderedCavityPolygonHE[i] };
+		HalfEdgeAccessor nextInCavity{ this, orderedCavityPolygonHE[(i + 1) % orderedCavityPolygonHE.size()] };
 		assert(current.next().handle() != INVALID_HALFEDGE_HANDLE);
 		assert(nextInCavity.next().next().handle() != INVALID_HALFEDGE_HANDLE);
 		current.next().setTwin(nextInCavity.next().next().handle());
@@ -621,25 +731,293 @@ inline void Triangulation::addVertex(Point* point)
 		//if (he.origin().leaving().handle() == INVALID_HALFEDGE_HANDLE)
 			he.origin().setLeaving(he.handle());
 	}
+	return newVertex.handle().idx;
+}
+
+inline size_t Triangulation::locateFace(const Point& point)
+{
+	assert(!m_activeFaces.empty());
+	// walk from the last created face, close to the point under the spatially coherent insertion order
+	size_t faceIdx = m_lastFace;
+	if (walk(faceIdx, point, m_walkStepBudget))
+		return faceIdx;
+	// jump - the walk got long, restart from the closest of a few random faces
+	double minDist = distSquared(*getFace({ faceIdx }).adjacentHalfEdge().origin().point(), point);
+	size_t sampleCount = static_cast<size_t>(std::cbrt(static_cast<double>(m_activeFaces.size())));
+	for (size_t i = 0; i < sampleCount; i++)
+	{
+		size_t candidate = m_activeFaces[Random::get<size_t>(0, m_activeFaces.size() - 1, m_engine)];
+		double d = distSquared(*getFace({ candidate }).adjacentHalfEdge().origin().point(), point);
+		if (d < minDist)
+		{
+			minDist = d;
+			faceIdx = candidate;
+		}
+	}
+	if (walk(faceIdx, point, m_activeFaces.size()))
+		return faceIdx;
+	// walk failed (degenerate configuration) - fall back to a full scan
+	for (const auto& idx : m_activeFaces)
+		if (isInCircumcircle(getFace({ idx }), point) || coincidentVertex(idx, point) != INVALID_VERTEX_HANDLE)
+			return idx;
+	assert(false && "point outside of the super triangle");
+	return faceIdx;
+}
+
+inline bool Triangulation::walk(size_t& faceIdx, const Point& point, size_t maxSteps)
+{
+	// cross any edge having the point on its right side,
+	// the first tested edge rotates so the walk cannot cycle forever
+	for (size_t step = 0; step < maxSteps; step++)
+	{
+		HalfEdgeAccessor he = getFace({ faceIdx }).adjacentHalfEdge();
+		for (size_t k = 0; k < step % 3; k++)
+			he = he.next();
+		bool moved = false;
+		for (int k = 0; k < 3 && !moved; k++, he = he.next())
+		{
+			if (orient2d(*he.origin().point(), *he.next().origin().point(), point) >= 0.0)
+				continue;
+			FaceHandle across = he.twin().adjacentFace().handle();
+			if (across != INVALID_FACE_HANDLE)
+			{
+				faceIdx = across.idx;
+				moved = true;
+			}
+		}
+		if (!moved)
+			return true;
+	}
+	return false;
+}
+
+inline Triangulation::VertexHandle Triangulation::coincidentVertex(size_t faceIdx, const Point& point)
+{
+	HalfEdgeAccessor he = getFace({ faceIdx }).adjacentHalfEdge();
+	for (int k = 0; k < 3; k++, he = he.next())
+	{
+		const Point& vertexPoint = *he.origin().point();
+		if (vertexPoint[0] == point[0] && vertexPoint[1] == point[1])
+			return he.origin().handle();
+	}
+	return INVALID_VERTEX_HANDLE;
+}
+
+inline Triangulation::HalfEdgeHandle Triangulation::findEdge(VertexHandle from, VertexHandle to)
+{
+	HalfEdgeAccessor first = getLeaving(from);
+	HalfEdgeAccessor current = first;
+	do
+	{
+		if (current.twin().origin().handle() == to)
+			return current.handle();
+		// next outgoing half-edge around the vertex
+		current = current.next().next().twin();
+	} while (current.handle() != first.handle());
+	return INVALID_HALFEDGE_HANDLE;
+}
+
+inline bool Triangulation::flipEdge(HalfEdgeHandle handle)
+{
+	// triangles abc and bad sharing edge ab become adc and dbc
+	HalfEdgeAccessor he{ this, handle };
+	HalfEdgeAccessor twin = he.twin();
+	HalfEdgeAccessor h1 = he.next(); // b -> c
+	HalfEdgeAccessor h2 = h1.next(); // c -> a
+	HalfEdgeAccessor t1 = twin.next(); // a -> d
+	HalfEdgeAccessor t2 = t1.next(); // d -> b
+	VertexAccessor a = he.origin();
+	VertexAccessor b = twin.origin();
+	VertexAccessor c = h2.origin();
+	VertexAccessor d = t2.origin();
+	// only a strictly convex quadrilateral adbc can be flipped
+	if (orient2d(*a.point(), *d.point(), *c.point()) <= 0.0 || orient2d(*d.point(), *b.point(), *c.point()) <= 0.0)
+		return false;
+	FaceAccessor f1 = he.adjacentFace();
+	FaceAccessor f2 = twin.adjacentFace();
+	he.setOrigin(d.handle());
+	twin.setOrigin(c.handle());
+	// face adc
+	t1.setNext(he.handle());
+	he.setNext(h2.handle());
+	h2.setNext(t1.handle());
+	t1.setAdjacentFace(f1.handle());
+	f1.setAdjacentHalfEdge(he.handle());
+	// face dbc
+	t2.setNext(h1.handle());
+	h1.setNext(twin.handle());
+	twin.setNext(t2.handle());
+	h1.setAdjacentFace(f2.handle());
+	f2.setAdjacentHalfEdge(twin.handle());
+	// a and b may have left through the flipped edge
+	if (a.leaving().handle() == handle)
+		a.setLeaving(t1.handle());
+	if (b.leaving().handle() == twin.handle())
+		b.setLeaving(h1.handle());
+	return true;
+}
+
+inline void Triangulation::insertConstraint(VertexHandle from, VertexHandle to)
+{
+	// boundary recovery by edge flips (Sloan) - the edges crossed by the segment
+	// are flipped until the segment appears, then the new edges are made Delaunay again
+	const Point& u = *getPoint(from);
+	const Point& v = *getPoint(to);
+	HalfEdgeHandle existing = findEdge(from, to);
+	if (existing != INVALID_HALFEDGE_HANDLE)
+	{
+		m_halfEdges[existing.idx].constrained = true;
+		m_halfEdges[getTwin(existing).handle().idx].constrained = true;
+		return;
+	}
+	// vertex lying exactly on the segment splits the constraint
+	auto isOnSegment = [&](const Point& p)
+		{
+			return orient2d(u, v, p) == 0.0 && dot(p - u, v - u) > 0.0 && dot(p - v, u - v) > 0.0;
+		};
+	// first crossed edge - opposite to the fan triangle of 'from' containing the segment direction
+	List<HalfEdgeHandle> crossing;
+	HalfEdgeAccessor first = getLeaving(from);
+	HalfEdgeAccessor current = first;
+	do
+	{
+		VertexAccessor w = current.twin().origin();
+		VertexAccessor x = current.next().next().origin();
+		if (isOnSegment(*w.point()))
+		{
+			insertConstraint(from, w.handle());
+			insertConstraint(w.handle(), to);
+			return;
+		}
+		if (orient2d(u, *w.point(), v) > 0.0 && orient2d(u, *x.point(), v) < 0.0)
+		{
+			crossing.pushBack(current.next().handle());
+			break;
+		}
+		current = current.next().next().twin();
+	} while (current.handle() != first.handle());
+	assert(!crossing.empty());
+	// walk along the segment collecting the crossed edges (w right, x left of the segment)
+	while (true)
+	{
+		HalfEdgeAccessor crossed = HalfEdgeAccessor{ this, crossing.back() }.twin(); // x -> w
+		VertexAccessor y = crossed.next().next().origin();
+		if (y.handle() == to)
+			break;
+		if (isOnSegment(*y.point()))
+		{
+			insertConstraint(from, y.handle());
+			insertConstraint(y.handle(), to);
+			return;
+		}
+		if (orient2d(u, v, *y.point()) > 0.0)
+			crossing.pushBack(crossed.next().handle()); // w -> y
+		else
+			crossing.pushBack(crossed.next().next().handle()); // y -> x
+	}
+	// flip crossing edges, postpone the ones with non-convex neighbourhood
+	auto crossesSegment = [&](HalfEdgeAccessor he)
+		{
+			const Point& p = *he.origin().point();
+			const Point& q = *he.twin().origin().point();
+			double side1 = orient2d(u, v, p);
+			double side2 = orient2d(u, v, q);
+			double side3 = orient2d(p, q, u);
+			double side4 = orient2d(p, q, v);
+			return ((side1 > 0.0 && side2 < 0.0) || (side1 < 0.0 && side2 > 0.0)) &&
+				((side3 > 0.0 && side4 < 0.0) || (side3 < 0.0 && side4 > 0.0));
+		};
+	Array<HalfEdgeHandle> newEdges;
+	while (!crossing.empty())
+	{
+		HalfEdgeHandle handle = crossing.front();
+		crossing.popFront();
+		if (!flipEdge(handle))
+		{
+			crossing.pushBack(handle);
+			continue;
+		}
+		if (crossesSegment({ this, handle }))
+			crossing.pushBack(handle);
+		else
+			newEdges.pushBack(handle);
+	}
+	HalfEdgeHandle recovered = findEdge(from, to);
+	assert(recovered != INVALID_HALFEDGE_HANDLE);
+	m_halfEdges[recovered.idx].constrained = true;
+	m_halfEdges[getTwin(recovered).handle().idx].constrained = true;
+	// restore the Delaunay property of the new unconstrained edges
+	bool flipped = true;
+	while (flipped)
+	{
+		flipped = false;
+		for (HalfEdgeHandle handle : newEdges)
+		{
+			HalfEdgeAccessor he{ this, handle };
+			if (m_halfEdges[handle.idx].constrained)
+				continue;
+			const Point& opposite = *he.twin().next().next().origin().point();
+			if (isInCircumcircle(he.adjacentFace(), opposite) && flipEdge(handle))
+				flipped = true;
+		}
+	}
 }
 
-inline void Triangulation::removeExteriorTriangles(const Boundaries& boundaries)
+inline void Triangulation::removeExteriorTriangles()
 {
-	// helper function to check if triangle is exterior
+	// flood fill from the super triangle, crossing a constrained edge toggles inside/outside
+	// (0-1 breadth first search: depth = number of boundary segments crossed)
+	Array<size_t> depth(m_faces.size(), INVALID_IDX);
+	Array<size_t> currentLayer;
+	Array<size_t> nextLayer;
+	for (const auto& faceIdx : m_activeFaces)
+	{
+		HalfEdgeAccessor he = getFace({ faceIdx }).adjacentHalfEdge();
+		for (int k = 0; k < 3; k++, he = he.next())
+			if (he.twin().adjacentFace().handle() == INVALID_FACE_HANDLE && depth[faceIdx] == INVALID_IDX)
+			{
+				depth[faceIdx] = 0;
+				currentLayer.pushBack(faceIdx);
+			}
+	}
+	for (size_t layer = 0; !currentLayer.empty(); layer++)
+	{
+		for (size_t i = 0; i < currentLayer.size(); i++)
+		{
+			HalfEdgeAccessor he = getFace({ currentLayer[i] }).adjacentHalfEdge();
+			for (int k = 0; k < 3; k++, he = he.next())
+			{
+				FaceHandle neighbor = he.twin().adjacentFace().handle();
+				if (neighbor == INVALID_FACE_HANDLE || depth[neighbor.idx] != INVALID_IDX)
+					continue;
+				if (m_halfEdges[he.handle().idx].constrained)
+					nextLayer.pushBack(neighbor.idx);
+				else
+				{
+					depth[neighbor.idx] = layer;
+					currentLayer.pushBack(neighbor.idx);
+				}
+			}
+		}
+		// faces reached only across constraints start the next layer
+		currentLayer.clear();
+		for (size_t faceIdx : nextLayer)
+			if (depth[faceIdx] == INVALID_IDX)
+			{
+				depth[faceIdx] = layer + 1;
+				currentLayer.pushBack(faceIdx);
+			}
+		nextLayer.clear();
+	}
+	// helper function to check if triangle is exterior (outside the outer boundary or inside a hole)
 	auto isExterior = [&](FaceAccessor face)
 		{
 			assert(face.handle() != INVALID_FACE_HANDLE);
-			assert((face.adjacentHalfEdge().next().next().next().handle() == face.adjacentHalfEdge().handle()));
-			HalfEdgeAccessor he = face.adjacentHalfEdge();
-			Point center = 1.0 / 3.0 * (
-				*(he.origin().point()) +
-				*(he.next().origin().point()) +
-				*(he.next().next().origin().point())
-				);
-			return !boundaries.pointInBoundaries(center);
+			assert(depth[face.handle().idx] != INVALID_IDX);
+			return depth[face.handle().idx] % 2 == 0;
 		};
 	// find exterior triangles
-	List<size_t> exteriorTriangleIndices;
+	Array<size_t> exteriorTriangleIndices;
 	for (const auto& faceIdx : m_activeFaces)
 	{
 		if (isExterior(getFace({faceIdx})))
@@ -649,6 +1027,7 @@ inline void Triangulation::removeExteriorTriangles(const Boundaries& boundaries)
 	Array<HalfEdgeHandle> heToRemove;
 	Array<HalfEdgeHandle> heToRelink; // boundary
 	Map<VertexHandle, HalfEdgeHandle, VertexHandleHash> originToHalfEdgeMap; // for relinking
+	originToHalfEdgeMap.reserve(exteriorTriangleIndices.size()); // usually one boundary edge per exterior face
 	for (const auto& exteriorIdx : exteriorTriangleIndices)
 	{
 		auto face = getFace({ exteriorIdx });
@@ -739,8 +1118,10 @@ inline Triangulation::FaceAccessor Triangulation::pushFace()
 {
 	size_t idx = m_freeFaces.front();
 	m_freeFaces.popFront();
-	m_activeFaces.pushBack(idx);
 	m_faces[idx].reset();
+	m_faces[idx].activePosition = m_activeFaces.size();
+	m_activeFaces.pushBack(idx);
+	m_lastFace = idx;
 	return { this, FaceHandle{idx} };
 }
 
@@ -772,33 +1153,23 @@ inline void Triangulation::removeWholeEdge(HalfEdgeHandle halfEdge)
 
 inline void Triangulation::removeFace(size_t activeFaceIdx)
 {
+	// swap with the last active face
+	size_t position = m_faces[activeFaceIdx].activePosition;
+	assert(position != INVALID_IDX && m_activeFaces[position] == activeFaceIdx);
+	m_activeFaces[position] = m_activeFaces.back();
+	m_faces[m_activeFaces[position]].activePosition = position;
+	m_activeFaces.popBack();
 	m_faces[activeFaceIdx].reset();
 	m_freeFaces.pushFront(activeFaceIdx);
+	if (m_lastFace == activeFaceIdx)
+		m_lastFace = m_activeFaces.empty() ? INVALID_IDX : m_activeFaces.back();
 }
 
-inline void Triangulation::removeFaces(const List<size_t>& faceIndices)
+template <typename Allocator>
+inline void Triangulation::removeFaces(const Array<size_t, Allocator>& faceIndices)
 {
-	if (faceIndices.empty())
-		return;
-	auto it = m_activeFaces.begin();
-	while (it != m_activeFaces.end())
-	{
-		// check if face should be removed
-		bool wasRemoved = false;
-		for (auto toRemoveIdx : faceIndices)
-		{
-			if (toRemoveIdx == *it)
-			{
-				m_faces[*it].reset();
-				m_freeFaces.pushFront(*it);
-				it = m_activeFaces.erase(it);
-				wasRemoved = true;
-				break;
-			}
-		}
-		if (!wasRemoved)
-			++it;
-	}
+	for (auto faceIdx : faceIndices)
+		removeFace(faceIdx);
 }
 
 inline void Triangulation::makeCompact()
@@ -910,30 +1281,42 @@ inline StaticArray<size_t, 3> Triangulation::getTriangleVertexIndices(size_t i)
 	return vertexIndices;
 }
 
+inline StaticArray<size_t, 3> Triangulation::getTriangleHalfEdgeIndices(size_t i) const
+{
+	StaticArray<size_t, 3> halfEdgeIndices;
+	halfEdgeIndices[0] = m_faces[i].adjacentHalfEdge;
+	halfEdgeIndices[1] = m_halfEdges[halfEdgeIndices[0]].next;
+	halfEdgeIndices[2] = m_halfEdges[halfEdgeIndices[1]].next;
+	return halfEdgeIndices;
+}
+
 inline size_t Triangulation::getTriangleCount() const
 {
 	return m_faces.size();
 }
 
+inline size_t Triangulation::halfEdgeCount() const
+{
+	return m_halfEdges.size();
+}
+
+inline size_t Triangulation::getHalfEdgeTwin(size_t i) const
+{
+	return m_halfEdges[i].twin;
+}
+
+inline bool Triangulation::isBoundaryHalfEdge(size_t i) const
+{
+	const HalfEdge& halfEdge = m_halfEdges[i];
+	// exterior faces are removed, their half-edges keep no face after compaction
+	return halfEdge.constrained || halfEdge.twin == INVALID_IDX || m_halfEdges[halfEdge.twin].adjacentFace == INVALID_IDX;
+}
+
 bool isInCircumcircle(Triangulation::FaceAccessor face, const Point& point)
 {
 	const Point& a = *(face.adjacentHalfEdge().origin().point());
 	const Point& b = *(face.adjacentHalfEdge().next().origin().point());
 	const Point& c = *(face.adjacentHalfEdge().next().next().origin().point());
-	// the point p is inside the circumcircle of abc (CCW) if the following determinant is positive:
-	// | ax-px  ay-py  (ax-px)^2+(ay-py)^2 |
-	// | bx-px  by-py  (bx-px)^2+(by-py)^2 | > 0
-	// | cx-px  cy-py  (cx-px)^2+(cy-py)^2 |
-
-	double ax = a[0]; double ay = a[1];
-	double bx = b[0]; double by = b[1];
-	double cx = c[0]; double cy = c[1];
-	double px = point[0]; double py = point[1];
-
-	constexpr double epsilon = 1e-12;
-
-	double det_val = (ax - px) * ((by - py) * (std::pow(cx - px, 2) + std::pow(cy - py, 2)) - (cy - py) * (std::pow(bx - px, 2) + std::pow(by - py, 2))) -
-		(ay - py) * ((bx - px) * (std::pow(cx - px, 2) + std::pow(cy - py, 2)) - (cx - px) * (std::pow(bx - px, 2) + std::pow(by - py, 2))) +
-		(std::pow(ax - px, 2) + std::pow(ay - py, 2)) * ((bx - px) * (cy - py) - (cx - px) * (by - py));
-	return det_val > -epsilon ? true : false;
-}
\ No newline at end of file
+	// strictly inside the circumcircle of CCW abc, exact sign (cocircular points are not bad)
+	return incircle(a, b, c, point) > 0.0;
+}
@@ -1,10 +1,18 @@
+#include <cstring>
 #include "Application.hpp"
 #include "solver/Mesh.hpp"
 #include "math/Polynomial.hpp"
 #include "solver/Solver.hpp"
+#include "solver/SolverChecks.hpp"
 
-int main()
+int main(int argc, char** argv)
 {
+    // kernel consistency checks on the default domain, without opening the window
+    if (argc > 1 && std::strcmp(argv[1], "--check") == 0)
+    {
+        Domain domain;
+        return checks::run(domain.getTriangulation()) ? 0 : 1;
+    }
     Application app(1440, 810);
     app.run();
 }
@@ -0,0 +1,435 @@
+#pragma once
+#include <cassert>
+#include <type_traits>
+#include "Vector.hpp"
+
+// polynomial in DIM variables (x, y, z) with inline storage, no allocation
+// holds the coefficients of x^i * y^j * z^k for i, j, k <= MAX_DEGREE,
+// flat index i + j * (MAX_DEGREE + 1) + k * (MAX_DEGREE + 1)^2
+// products widen the degree bound at compile time, so element calculus never overflows
+template <typename T, size_t MAX_DEGREE, size_t DIM>
+class StaticPolynomial
+{
+	static_assert(DIM >= 1 && DIM <= 3, "StaticPolynomial supports 1 to 3 variables");
+public:
+	static constexpr size_t STRIDE = MAX_DEGREE + 1;
+	static constexpr size_t SIZE = DIM == 1 ? STRIDE : (DIM == 2 ? STRIDE * STRIDE : STRIDE * STRIDE * STRIDE);
+private:
+	T m_coeffs[SIZE]{};
+public:
+	constexpr StaticPolynomial() = default;
+	constexpr StaticPolynomial(const T& constant);
+	// widening from a polynomial with a lower degree bound
+	template <size_t OTHER_DEGREE>
+	constexpr StaticPolynomial(const StaticPolynomial<T, OTHER_DEGREE, DIM>& other);
+	constexpr StaticPolynomial(const StaticPolynomial& other) = default;
+	constexpr StaticPolynomial(StaticPolynomial&& other) noexcept = default;
+	~StaticPolynomial() = default;
+	constexpr StaticPolynomial& operator=(const StaticPolynomial& other) = default;
+	constexpr StaticPolynomial& operator=(StaticPolynomial&& other) noexcept = default;
+
+	// the polynomial x, y or z
+	static constexpr StaticPolynomial variable(size_t axis);
+	static constexpr size_t exponent(size_t index, size_t axis);
+
+	constexpr bool operator==(const StaticPolynomial& other) const;
+	constexpr bool operator!=(const StaticPolynomial& other) const;
+	constexpr int degree() const; // total degree, -1 for the 0 polynomial
+	constexpr const T& operator[](size_t index) const;
+	constexpr T& operator[](size_t index);
+	// coefficient by exponents, e.g. coeff(i, j) of x^i * y^j
+	template <typename... Exponents>
+	constexpr const T& coeff(Exponents... exponents) const;
+	template <typename... Exponents>
+	constexpr T& coeff(Exponents... exponents);
+
+	constexpr StaticPolynomial& operator+=(const StaticPolynomial& other);
+	constexpr StaticPolynomial& operator-=(const StaticPolynomial& other);
+	constexpr StaticPolynomial& operator*=(const T& a);
+	constexpr StaticPolynomial& operator/=(const T& a);
+	template <typename... Coords>
+	constexpr T operator()(Coords... coords) const;
+
+	constexpr StaticPolynomial derivative(size_t axis) const;
+	// indefinite integral with 0 constant
+	constexpr StaticPolynomial<T, MAX_DEGREE + 1, DIM> indefiniteIntegral(size_t axis) const;
+private:
+	template <typename... Exponents>
+	static constexpr size_t index(Exponents... exponents);
+};
+
+template <typename T>
+struct is_static_polynomial : std::false_type {};
+template <typename T, size_t MAX_DEGREE, size_t DIM>
+struct is_static_polynomial<StaticPolynomial<T, MAX_DEGREE, DIM>> : std::true_type {};
+template <typename T>
+inline constexpr bool is_static_polynomial_v = is_static_polynomial<T>::value;
+
+template<typename T, size_t MAX_DEGREE, size_t DIM>
+inline constexpr StaticPolynomial<T, MAX_DEGREE, DIM>::StaticPolynomial(const T& constant) : m_coeffs{ constant } {}
+
+template<typename T, size_t MAX_DEGREE, size_t DIM>
+template<size_t OTHER_DEGREE>
+inline constexpr StaticPolynomial<T, MAX_DEGREE, DIM>::StaticPolynomial(const StaticPolynomial<T, OTHER_DEGREE, DIM>& other)
+{
+	static_assert(OTHER_DEGREE <= MAX_DEGREE, "StaticPolynomial can only be widened to a higher degree bound");
+	using Other = StaticPolynomial<T, OTHER_DEGREE, DIM>;
+	for (size_t k = 0; k < Other::SIZE; k++)
+	{
+		size_t target = 0;
+		size_t stride = 1;
+		for (size_t axis = 0; axis < DIM; axis++)
+		{
+			target += Other::exponent(k, axis) * stride;
+			stride *= STRIDE;
+		}
+		m_coeffs[target] = other[k];
+	}
+}
+
+template<typename T, size_t MAX_DEGREE, size_t DIM>
+inline constexpr StaticPolynomial<T, MAX_DEGREE, DIM> StaticPolynomial<T, MAX_DEGREE, DIM>::variable(size_t axis)
+{
+	static_assert(MAX_DEGREE >= 1, "StaticPolynomial of degree 0 cannot hold a variable");
+	StaticPolynomial result;
+	size_t stride = 1;
+	for (size_t d = 0; d < axis; d++)
+		stride *= STRIDE;
+	result.m_coeffs[stride] = T(1);
+	return result;
+}
+
+template<typename T, size_t MAX_DEGREE, size_t DIM>
+inline constexpr size_t StaticPolynomial<T, MAX_DEGREE, DIM>::exponent(size_t index, size_t axis)
+{
+	for (size_t d = 0; d < axis; d++)
+		index /= STRIDE;
+	return index % STRIDE;
+}
+
+template<typename T, size_t MAX_DEGREE, size_t DIM>
+inline constexpr bool StaticPolynomial<T, MAX_DEGREE, DIM>::operator==(const StaticPolynomial& other) const
+{
+	for (size_t k = 0; k < SIZE; k++)
+		if (m_coeffs[k] != other.m_coeffs[k])
+			return false;
+	return true;
+}
+
+template<typename T, size_t MAX_DEGREE, size_t DIM>
+inline constexpr bool StaticPolynomial<T, MAX_DEGREE, DIM>::operator!=(const StaticPolynomial& other) const
+{
+	return !(*this == other);
+}
+
+template<typename T, size_t MAX_DEGREE, size_t DIM>
+inline constexpr int StaticPolynomial<T, MAX_DEGREE, DIM>::degree() const
+{
+	int deg = -1;
+	for (size_t k = 0; k < SIZE; k++)
+	{
+		if (m_coeffs[k] == T{})
+			continue;
+		int total = 0;
+		for (size_t axis = 0; axis < DIM; axis++)
+			total += static_cast<int>(exponent(k, axis));
+		deg = total > deg ? total : deg;
+	}
+	return deg;
+}
+
+template<typename T, size_t MAX_DEGREE, size_t DIM>
+inline constexpr const T& StaticPolynomial<T, MAX_DEGREE, DIM>::operator[](size_t index) const
+{
+	return m_coeffs[index];
+}
+
+template<typename T, size_t MAX_DEGREE, size_t DIM>
+inline constexpr T& StaticPolynomial<T, MAX_DEGREE, DIM>::operator[](size_t index)
+{
+	return m_coeffs[index];
+}
+
+template<typename T, size_t MAX_DEGREE, size_t DIM>
+template<typename... Exponents>
+inline constexpr const T& StaticPolynomial<T, MAX_DEGREE, DIM>::coeff(Exponents... exponents) const
+{
+	return m_coeffs[index(exponents...)];
+}
+
+template<typename T, size_t MAX_DEGREE, size_t DIM>
+template<typename... Exponents>
+inline constexpr T& StaticPolynomial<T, MAX_DEGREE, DIM>::coeff(Exponents... exponents)
+{
+	return m_coeffs[index(exponents...)];
+}
+
+template<typename T, size_t MAX_DEGREE, size_t DIM>
+inline constexpr StaticPolynomial<T, MAX_DEGREE, DIM>& StaticPolynomial<T, MAX_DEGREE, DIM>::operator+=(const StaticPolynomial& other)
+{
+	for (size_t k = 0; k < SIZE; k++)
+		m_coeffs[k] += other.m_coeffs[k];
+	return *this;
+}
+
+template<typename T, size_t MAX_DEGREE, size_t DIM>
+inline constexpr StaticPolynomial<T, MAX_DEGREE, DIM>& StaticPolynomial<T, MAX_DEGREE, DIM>::operator-=(const StaticPolynomial& other)
+{
+	for (size_t k = 0; k < SIZE; k++)
+		m_coeffs[k] -= other.m_coeffs[k];
+	return *this;
+}
+
+template<typename T, size_t MAX_DEGREE, size_t DIM>
+inline constexpr StaticPolynomial<T, MAX_DEGREE, DIM>& StaticPolynomial<T, MAX_DEGREE, DIM>::operator*=(const T& a)
+{
+	for (size_t k = 0; k < SIZE; k++)
+		m_coeffs[k] *= a;
+	return *this;
+}
+
+template<typename T, size_t MAX_DEGREE, size_t DIM>
+inline constexpr StaticPolynomial<T, MAX_DEGREE, DIM>& StaticPolynomial<T, MAX_DEGREE, DIM>::operator/=(const T& a)
+{
+	for (size_t k = 0; k < SIZE; k++)
+		m_coeffs[k] /= a;
+	return *this;
+}
+
+template<typename T, size_t MAX_DEGREE, size_t DIM>
+template<typename... Coords>
+inline constexpr T StaticPolynomial<T, MAX_DEGREE, DIM>::operator()(Coords... coords) const
+{
+	static_assert(sizeof...(Coords) == DIM, "StaticPolynomial evaluated with a wrong number of coordinates");
+	const T point[DIM] = { static_cast<T>(coords)... };
+	// powers[axis][e] = point[axis]^e
+	T powers[DIM][STRIDE]{};
+	for (size_t axis = 0; axis < DIM; axis++)
+	{
+		powers[axis][0] = T(1);
+		for (size_t e = 1; e < STRIDE; e++)
+			powers[axis][e] = powers[axis][e - 1] * point[axis];
+	}
+	T result{};
+	for (size_t k = 0; k < SIZE; k++)
+	{
+		if (m_coeffs[k] == T{})
+			continue;
+		T term = m_coeffs[k];
+		for (size_t axis = 0; axis < DIM; axis++)
+			term *= powers[axis][exponent(k, axis)];
+		result += term;
+	}
+	return result;
+}
+
+template<typename T, size_t MAX_DEGREE, size_t DIM>
+inline constexpr StaticPolynomial<T, MAX_DEGREE, DIM> StaticPolynomial<T, MAX_DEGREE, DIM>::derivative(size_t axis) const
+{
+	StaticPolynomial result;
+	size_t stride = 1;
+	for (size_t d = 0; d < axis; d++)
+		stride *= STRIDE;
+	for (size_t k = 0; k < SIZE; k++)
+	{
+		size_t e = exponent(k, axis);
+		if (e > 0)
+			result.m_coeffs[k - stride] = m_coeffs[k] * static_cast<T>(e);
+	}
+	return result;
+}
+
+template<typename T, size_t MAX_DEGREE, size_t DIM>
+inline constexpr StaticPolynomial<T, MAX_DEGREE + 1, DIM> StaticPolynomial<T, MAX_DEGREE, DIM>::indefiniteIntegral(size_t axis) const
+{
+	// widen first, then shift the exponent in the wider layout
+	const StaticPolynomial<T, MAX_DEGREE + 1, DIM> wide(*this);
+	StaticPolynomial<T, MAX_DEGREE + 1, DIM> result;
+	using Wide = StaticPolynomial<T, MAX_DEGREE + 1, DIM>;
+	size_t stride = 1;
+	for (size_t d = 0; d < axis; d++)
+		stride *= Wide::STRIDE;
+	for (size_t k = 0; k < Wide::SIZE; k++)
+	{
+		size_t e = Wide::exponent(k, axis);
+		if (e < MAX_DEGREE + 1 && wide[k] != T{})
+			result[k + stride] = wide[k] / static_cast<T>(e + 1);
+	}
+	return result;
+}
+
+template<typename T, size_t MAX_DEGREE, size_t DIM>
+template<typename... Exponents>
+inline constexpr size_t StaticPolynomial<T, MAX_DEGREE, DIM>::index(Exponents... exponents)
+{
+	static_assert(sizeof...(Exponents) == DIM, "StaticPolynomial coefficient needs one exponent per variable");
+	const size_t e[DIM] = { static_cast<size_t>(exponents)... };
+	size_t result = 0;
+	size_t stride = 1;
+	for (size_t axis = 0; axis < DIM; axis++)
+	{
+		assert(e[axis] <= MAX_DEGREE);
+		result += e[axis] * stride;
+		stride *= STRIDE;
+	}
+	return result;
+}
+
+// non-member operators and functions
+
+template<typename T, size_t MAX_DEGREE, size_t DIM>
+inline constexpr StaticPolynomial<T, MAX_DEGREE, DIM> operator-(const StaticPolynomial<T, MAX_DEGREE, DIM>& p)
+{
+	StaticPolynomial<T, MAX_DEGREE, DIM> result(p);
+	return result *= T(-1);
+}
+
+template<typename T, size_t MAX_DEGREE, size_t DIM>
+inline constexpr StaticPolynomial<T, MAX_DEGREE, DIM> operator+(const StaticPolynomial<T, MAX_DEGREE, DIM>& p, const StaticPolynomial<T, MAX_DEGREE, DIM>& q)
+{
+	StaticPolynomial<T, MAX_DEGREE, DIM> result(p);
+	return result += q;
+}
+
+template<typename T, size_t MAX_DEGREE, size_t DIM>
+inline constexpr StaticPolynomial<T, MAX_DEGREE, DIM> operator-(const StaticPolynomial<T, MAX_DEGREE, DIM>& p, const StaticPolynomial<T, MAX_DEGREE, DIM>& q)
+{
+	StaticPolynomial<T, MAX_DEGREE, DIM> result(p);
+	return result -= q;
+}
+
+// scalar operations, the scalar is converted to the coefficient type
+template<typename T, size_t MAX_DEGREE, size_t DIM, typename S, typename = std::enable_if_t<!is_static_polynomial_v<S>>>
+inline constexpr StaticPolynomial<T, MAX_DEGREE, DIM> operator+(const StaticPolynomial<T, MAX_DEGREE, DIM>& p, const S& a)
+{
+	StaticPolynomial<T, MAX_DEGREE, DIM> result(p);
+	result[0] += static_cast<T>(a);
+	return result;
+}
+
+template<typename T, size_t MAX_DEGREE, size_t DIM, typename S, typename = std::enable_if_t<!is_static_polynomial_v<S>>>
+inline constexpr StaticPolynomial<T, MAX_DEGREE, DIM> operator+(const S& a, const StaticPolynomial<T, MAX_DEGREE, DIM>& p)
+{
+	return p + a;
+}
+
+template<typename T, size_t MAX_DEGREE, size_t DIM, typename S, typename = std::enable_if_t<!is_static_polynomial_v<S>>>
+inline constexpr StaticPolynomial<T, MAX_DEGREE, DIM> operator-(const StaticPolynomial<T, MAX_DEGREE, DIM>& p, const S& a)
+{
+	StaticPolynomial<T, MAX_DEGREE, DIM> result(p);
+	result[0] -= static_cast<T>(a);
+	return result;
+}
+
+template<typename T, size_t MAX_DEGREE, size_t DIM, typename S, typename = std::enable_if_t<!is_static_polynomial_v<S>>>
+inline constexpr StaticPolynomial<T, MAX_DEGREE, DIM> operator-(const S& a, const StaticPolynomial<T, MAX_DEGREE, DIM>& p)
+{
+	return -p + a;
+}
+
+template<typename T, size_t MAX_DEGREE, size_t DIM, typename S, typename = std::enable_if_t<!is_static_polynomial_v<S>>>
+inline constexpr StaticPolynomial<T, MAX_DEGREE, DIM> operator*(const StaticPolynomial<T, MAX_DEGREE, DIM>& p, const S& a)
+{
+	StaticPolynomial<T, MAX_DEGREE, DIM> result(p);
+	return result *= static_cast<T>(a);
+}
+
+template<typename T, size_t MAX_DEGREE, size_t DIM, typename S, typename = std::enable_if_t<!is_static_polynomial_v<S>>>
+inline constexpr StaticPolynomial<T, MAX_DEGREE, DIM> operator*(const S& a, const StaticPolynomial<T, MAX_DEGREE, DIM>& p)
+{
+	return p * a;
+}
+
+template<typename T, size_t MAX_DEGREE, size_t DIM, typename S, typename = std::enable_if_t<!is_static_polynomial_v<S>>>
+inline constexpr StaticPolynomial<T, MAX_DEGREE, DIM> operator/(const StaticPolynomial<T, MAX_DEGREE, DIM>& p, const S& a)
+{
+	StaticPolynomial<T, MAX_DEGREE, DIM> result(p);
+	return result /= static_cast<T>(a);
+}
+
+// product, the degree bounds add up
+template<typename T, size_t P_DEGREE, size_t Q_DEGREE, size_t DIM>
+inline constexpr StaticPolynomial<T, P_DEGREE + Q_DEGREE, DIM> operator*(const StaticPolynomial<T, P_DEGREE, DIM>& p, const StaticPolynomial<T, Q_DEGREE, DIM>& q)
+{
+	using P = StaticPolynomial<T, P_DEGREE, DIM>;
+	using Q = StaticPolynomial<T, Q_DEGREE, DIM>;
+	using Result = StaticPolynomial<T, P_DEGREE + Q_DEGREE, DIM>;
+	Result result;
+	for (size_t a = 0; a < P::SIZE; a++)
+	{
+		if (p[a] == T{})
+			continue;
+		for (size_t b = 0; b < Q::SIZE; b++)
+		{
+			if (q[b] == T{})
+				continue;
+			size_t target = 0;
+			size_t stride = 1;
+			for (size_t axis = 0; axis < DIM; axis++)
+			{
+				target += (P::exponent(a, axis) + Q::exponent(b, axis)) * stride;
+				stride *= Result::STRIDE;
+			}
+			result[target] += p[a] * q[b];
+		}
+	}
+	return result;
+}
+
+template<typename T, size_t MAX_DEGREE, size_t DIM>
+inline constexpr StaticPolynomial<T, MAX_DEGREE, DIM> derivative(const StaticPolynomial<T, MAX_DEGREE, DIM>& p, size_t axis)
+{
+	return p.derivative(axis);
+}
+
+template<typename T, size_t MAX_DEGREE, size_t DIM>
+inline constexpr StaticPolynomial<T, MAX_DEGREE + 1, DIM> indefiniteIntegral(const StaticPolynomial<T, MAX_DEGREE, DIM>& p, size_t axis)
+{
+	return p.indefiniteIntegral(axis);
+}
+
+// integral of x^i * y^j * z^k over the reference simplex: i! j! k! / (i + j + k + DIM)!
+// (unit interval [0, 1], triangle (0,0), (1,0), (0,1), tetrahedron (0,0,0), (1,0,0), (0,1,0), (0,0,1))
+template<typename T, size_t MAX_DEGREE, size_t DIM>
+inline constexpr T integral(const StaticPolynomial<T, MAX_DEGREE, DIM>& p)
+{
+	using P = StaticPolynomial<T, MAX_DEGREE, DIM>;
+	T result{};
+	for (size_t k = 0; k < P::SIZE; k++)
+	{
+		if (p[k] == T{})
+			continue;
+		// divide by (total + DIM)! / prod(e!) one factor at a time
+		T monomial = T(1);
+		size_t n = DIM;
+		for (size_t axis = 0; axis < DIM; axis++)
+		{
+			size_t e = P::exponent(k, axis);
+			for (size_t f = 1; f <= e; f++)
+				monomial = monomial * static_cast<T>(f) / static_cast<T>(++n);
+		}
+		for (size_t f = 2; f <= DIM; f++)
+			monomial /= static_cast<T>(f);
+		result += p[k] * monomial;
+	}
+	return result;
+}
+
+template<typename T, size_t MAX_DEGREE, size_t DIM>
+inline Vector<StaticPolynomial<T, MAX_DEGREE, DIM>, DIM> gradient(const StaticPolynomial<T, MAX_DEGREE, DIM>& p)
+{
+	Vector<StaticPolynomial<T, MAX_DEGREE, DIM>, DIM> grad;
+	for (size_t axis = 0; axis < DIM; axis++)
+		grad[axis] = p.derivative(axis);
+	return grad;
+}
+
+// dot product of polynomial vectors (e.g. gradients), the degree bound doubles
+template<typename T, size_t MAX_DEGREE, size_t DIM, size_t N>
+inline StaticPolynomial<T, 2 * MAX_DEGREE, DIM> dot(const Vector<StaticPolynomial<T, MAX_DEGREE, DIM>, N>& u, const Vector<StaticPolynomial<T, MAX_DEGREE, DIM>, N>& v)
+{
+	StaticPolynomial<T, 2 * MAX_DEGREE, DIM> result;
+	for (size_t i = 0; i < N; i++)
+		result += u[i] * v[i];
+	return result;
+}
@@ -0,0 +1,155 @@
+#pragma once
+#include <cmath>
+#include "data_structures/Array.hpp"
+#include "data_structures/StaticArray.hpp"
+#include "geometry/Point.hpp"
+#include "ReferenceTables.hpp"
+
+// elements per batch, one vector register of doubles (AVX-512: 8, otherwise 4)
+// the batch kernels are plain loops over the lanes of structure-of-arrays streams,
+// which the compiler turns into vector instructions of the target set by FEMSOLVER_SIMD
+#if defined(__AVX512F__)
+#define ELEMENT_BATCH_SIZE 8
+#else
+#define ELEMENT_BATCH_SIZE 4
+#endif
+
+// forward declaration
+template <typename T, int N_NODES>
+class Mesh;
+
+// structure-of-arrays view of the elements in color order (position k holds mesh.coloredElement(k)),
+// the positions of a color are the mesh ranges [mesh.colorBegin(c), mesh.colorEnd(c))
+// node indices and the coordinates of the 3 vertex nodes are kept in separate streams,
+// padded by one batch with the reference triangle so kernels always run whole batches
+template <typename T, int N_NODES>
+class ElementGeometry
+{
+public:
+	static constexpr size_t BATCH = ELEMENT_BATCH_SIZE;
+	// per lane coeff * |det J| * JinvT^T * JinvT (see ReferenceElement::Metric) and |det J|
+	struct BatchMetrics
+	{
+		T c00[BATCH];
+		T c01[BATCH];
+		T c11[BATCH];
+		T absDetJ[BATCH];
+	};
+private:
+	size_t m_elementCount = 0;
+	StaticArray<Array<size_t>, N_NODES> m_nodes; // m_nodes[i][k] - node i of the element at position k
+	StaticArray<Array<T>, 3> m_x; // vertex coordinates
+	StaticArray<Array<T>, 3> m_y;
+public:
+	ElementGeometry() = default;
+	~ElementGeometry() = default;
+	ElementGeometry(const ElementGeometry&) = delete;
+	ElementGeometry(ElementGeometry&&) = delete;
+	ElementGeometry& operator=(const ElementGeometry&) = delete;
+	ElementGeometry& operator=(ElementGeometry&&) = delete;
+	void build(const Mesh<T, N_NODES>& mesh);
+
+	size_t elementCount() const;
+	const size_t* nodes(int i) const; // stream of node i, indexed by position
+
+	// kernels over the batch of positions [first, first + BATCH)
+	void metrics(size_t first, const T (&coeffs)[BATCH], BatchMetrics& result) const;
+	// gradient at the centroid of the field with nodal values values[i][lane]
+	void centroidGradients(size_t first, const T (&values)[N_NODES][BATCH], T (&gx)[BATCH], T (&gy)[BATCH]) const;
+};
+
+template<typename T, int N_NODES>
+inline void ElementGeometry<T, N_NODES>::build(const Mesh<T, N_NODES>& mesh)
+{
+	m_elementCount = mesh.elementCount();
+	const size_t padded = m_elementCount + BATCH;
+	for (int i = 0; i < N_NODES; i++)
+		m_nodes[i] = Array<size_t>(padded, 0);
+	const T reference[3][2] = { { 0.0, 0.0 }, { 1.0, 0.0 }, { 0.0, 1.0 } };
+	for (int v = 0; v < 3; v++)
+	{
+		m_x[v] = Array<T>(padded, reference[v][0]);
+		m_y[v] = Array<T>(padded, reference[v][1]);
+	}
+	for (size_t k = 0; k < m_elementCount; k++)
+	{
+		const auto& elem = mesh.element(mesh.coloredElement(k));
+		for (int i = 0; i < N_NODES; i++)
+			m_nodes[i][k] = elem.nodeIdx(i);
+		for (int v = 0; v < 3; v++)
+		{
+			const Point& p = mesh.node(elem.nodeIdx(v)).position();
+			m_x[v][k] = p[0];
+			m_y[v][k] = p[1];
+		}
+	}
+}
+
+template<typename T, int N_NODES>
+inline size_t ElementGeometry<T, N_NODES>::elementCount() const
+{
+	return m_elementCount;
+}
+
+template<typename T, int N_NODES>
+inline const size_t* ElementGeometry<T, N_NODES>::nodes(int i) const
+{
+	return m_nodes[i].data();
+}
+
+template<typename T, int N_NODES>
+inline void ElementGeometry<T, N_NODES>::metrics(size_t first, const T (&coeffs)[BATCH], BatchMetrics& result) const
+{
+	const T* x0 = m_x[0].data() + first;
+	const T* x1 = m_x[1].data() + first;
+	const T* x2 = m_x[2].data() + first;
+	const T* y0 = m_y[0].data() + first;
+	const T* y1 = m_y[1].data() + first;
+	const T* y2 = m_y[2].data() + first;
+	for (size_t l = 0; l < BATCH; l++)
+	{
+		// J = [e1 e2] with the edges e1 = p1 - p0, e2 = p2 - p0 as columns,
+		// JinvT^T * JinvT = [|e2|^2, -e1.e2; -e1.e2, |e1|^2] / det^2
+		const T e1x = x1[l] - x0[l];
+		const T e1y = y1[l] - y0[l];
+		const T e2x = x2[l] - x0[l];
+		const T e2y = y2[l] - y0[l];
+		const T absDetJ = std::abs(e1x * e2y - e2x * e1y);
+		const T scale = coeffs[l] / absDetJ;
+		result.c00[l] = scale * (e2x * e2x + e2y * e2y);
+		result.c01[l] = -scale * (e1x * e2x + e1y * e2y);
+		result.c11[l] = scale * (e1x * e1x + e1y * e1y);
+		result.absDetJ[l] = absDetJ;
+	}
+}
+
+template<typename T, int N_NODES>
+inline void ElementGeometry<T, N_NODES>::centroidGradients(size_t first, const T (&values)[N_NODES][BATCH], T (&gx)[BATCH], T (&gy)[BATCH]) const
+{
+	// reference gradients at the centroid are compile time constants
+	const auto& reference = referenceTables<T, N_NODES>.centroidGradients;
+	const T* x0 = m_x[0].data() + first;
+	const T* x1 = m_x[1].data() + first;
+	const T* x2 = m_x[2].data() + first;
+	const T* y0 = m_y[0].data() + first;
+	const T* y1 = m_y[1].data() + first;
+	const T* y2 = m_y[2].data() + first;
+	for (size_t l = 0; l < BATCH; l++)
+	{
+		T g0{};
+		T g1{};
+		for (int i = 0; i < N_NODES; i++)
+		{
+			g0 += reference[i][0] * values[i][l];
+			g1 += reference[i][1] * values[i][l];
+		}
+		// grad = JinvT * gradRef, JinvT = [e2y, -e1y; -e2x, e1x] / det
+		const T e1x = x1[l] - x0[l];
+		const T e1y = y1[l] - y0[l];
+		const T e2x = x2[l] - x0[l];
+		const T e2y = y2[l] - y0[l];
+		const T invDet = T(1) / (e1x * e2y - e2x * e1y);
+		gx[l] = (e2y * g0 - e1y * g1) * invDet;
+		gy[l] = (-e2x * g0 + e1x * g1) * invDet;
+	}
+}
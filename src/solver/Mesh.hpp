@@ -1,10 +1,14 @@
 #pragma once
+#include <algorithm>
+#include <limits>
 #include "data_structures/Array.hpp"
 #include "geometry/Point.hpp"
 #include "geometry/Triangulation.hpp"
 #include "Node.hpp"
 #include "FiniteElement.hpp"
 #include "ReferenceElement.hpp"
+#include "ElementGeometry.hpp"
+#include "tools/ThreadPool.hpp"
 
 
 template<typename T, int N_NODES>
@@ -15,6 +19,10 @@ private:
 	Array<Node> m_nodes;
 	Array<FiniteElement<N_NODES>> m_elements;
 	ReferenceElement<T, N_NODES> m_referenceElement;
+	// element coloring, no two elements of one color share a node
+	Array<size_t> m_colorPtr;
+	Array<size_t> m_coloredElements; // element indices grouped by color
+	ElementGeometry<T, N_NODES> m_geometry; // elements in color order for the batch kernels
 public:
 	Mesh(const Triangulation& triangulation);
 	~Mesh() = default;
@@ -30,6 +38,17 @@ public:
 	const Node& node(size_t i) const;
 	const FiniteElement<N_NODES>& element(size_t i) const;
 	const ReferenceElement<T, N_NODES>& referenceElement() const;
+	const ElementGeometry<T, N_NODES>& geometry() const;
+	size_t colorCount() const;
+	size_t colorBegin(size_t color) const;
+	size_t colorEnd(size_t color) const;
+	size_t coloredElement(size_t k) const;
+	// gradient at the element centroids of the field with nodal values values[node], by element index
+	template<typename Values>
+	void centroidGradients(const Values& values, Array<Point>& gradients) const;
+private:
+	void addQuadraticElements(const Triangulation& triangulation);
+	void computeColoring();
 };
 
 template<typename T, int N_NODES>
@@ -41,11 +60,24 @@ inline Mesh<T, N_NODES>::Mesh(const Triangulation& triangulation)
 		int boundaryId = triangulation.getVertexBoundaryId(i);
 		m_nodes.pushBack({ p, boundaryId });
 	}
-	for (size_t i = 0; i < triangulation.getTriangleCount(); i++)
+	if constexpr (N_NODES == 3)
 	{
-		m_elements.pushBack(triangulation.getTriangleVertexIndices(i));
-		m_elements.back().setMaterial(0);
+		for (size_t i = 0; i < triangulation.getTriangleCount(); i++)
+		{
+			m_elements.pushBack(triangulation.getTriangleVertexIndices(i));
+			m_elements.back().setMaterial(0);
+		}
 	}
+	else if constexpr (N_NODES == 6)
+	{
+		addQuadraticElements(triangulation);
+	}
+	else
+	{
+		static_assert(sizeof(T) == 0, "Unsupported element type (incorrect N_NODES in Mesh)\n");
+	}
+	computeColoring();
+	m_geometry.build(*this);
 }
 
 template<typename T, int N_NODES>
@@ -90,4 +122,148 @@ inline const ReferenceElement<T, N_NODES>& Mesh<T, N_NODES>::referenceElement()
 	return m_referenceElement;
 }
 
- 
\ No newline at end of file
+template<typename T, int N_NODES>
+inline const ElementGeometry<T, N_NODES>& Mesh<T, N_NODES>::geometry() const
+{
+	return m_geometry;
+}
+
+template<typename T, int N_NODES>
+inline size_t Mesh<T, N_NODES>::colorCount() const
+{
+	return m_colorPtr.size() - 1;
+}
+
+template<typename T, int N_NODES>
+inline size_t Mesh<T, N_NODES>::colorBegin(size_t color) const
+{
+	return m_colorPtr[color];
+}
+
+template<typename T, int N_NODES>
+inline size_t Mesh<T, N_NODES>::colorEnd(size_t color) const
+{
+	return m_colorPtr[color + 1];
+}
+
+template<typename T, int N_NODES>
+inline size_t Mesh<T, N_NODES>::coloredElement(size_t k) const
+{
+	return m_coloredElements[k];
+}
+
+template<typename T, int N_NODES>
+template<typename Values>
+inline void Mesh<T, N_NODES>::centroidGradients(const Values& values, Array<Point>& gradients) const
+{
+	constexpr size_t BATCH = ElementGeometry<T, N_NODES>::BATCH;
+	gradients.resize(elementCount());
+	ThreadPool::instance().parallelFor(m_geometry.elementCount(), [&](size_t begin, size_t end)
+		{
+			T nodeValues[N_NODES][BATCH];
+			T gx[BATCH];
+			T gy[BATCH];
+			for (size_t first = begin; first < end; first += BATCH)
+			{
+				const size_t count = std::min(BATCH, end - first);
+				for (int i = 0; i < N_NODES; i++)
+				{
+					const size_t* nodes = m_geometry.nodes(i) + first;
+					for (size_t l = 0; l < BATCH; l++)
+						nodeValues[i][l] = values[nodes[l]];
+				}
+				m_geometry.centroidGradients(first, nodeValues, gx, gy);
+				for (size_t l = 0; l < count; l++)
+					gradients[coloredElement(first + l)] = Point{ gx[l], gy[l] };
+			}
+		}, ThreadPool::DEFAULT_CHUNK_SIZE / 16);
+}
+
+template<typename T, int N_NODES>
+inline void Mesh<T, N_NODES>::addQuadraticElements(const Triangulation& triangulation)
+{
+	// one mid-edge node per edge, shared by the two half-edges of the edge
+	const size_t noNode = std::numeric_limits<size_t>::max();
+	Array<size_t> midNodes(triangulation.halfEdgeCount(), noNode);
+	StaticArray<size_t, N_NODES> nodes;
+	for (size_t i = 0; i < triangulation.getTriangleCount(); i++)
+	{
+		StaticArray<size_t, 3> vertices = triangulation.getTriangleVertexIndices(i);
+		StaticArray<size_t, 3> halfEdges = triangulation.getTriangleHalfEdgeIndices(i);
+		for (int k = 0; k < 3; k++)
+		{
+			nodes[k] = vertices[k];
+			const size_t he = halfEdges[k];
+			if (midNodes[he] == noNode)
+			{
+				const Node& from = m_nodes[vertices[k]];
+				const Node& to = m_nodes[vertices[(k + 1) % 3]];
+				// a chord between two boundary vertices is an interior edge
+				int boundaryId = -1;
+				if (triangulation.isBoundaryHalfEdge(he) && from.boundaryId() == to.boundaryId())
+					boundaryId = from.boundaryId();
+				midNodes[he] = m_nodes.size();
+				m_nodes.pushBack({ 0.5 * (from.position() + to.position()), boundaryId });
+				const size_t twin = triangulation.getHalfEdgeTwin(he);
+				if (twin != Triangulation::INVALID_IDX)
+					midNodes[twin] = midNodes[he];
+			}
+			nodes[k + 3] = midNodes[he];
+		}
+		m_elements.pushBack(nodes);
+		m_elements.back().setMaterial(0);
+	}
+}
+
+template<typename T, int N_NODES>
+inline void Mesh<T, N_NODES>::computeColoring()
+{
+	const size_t nodeCount = m_nodes.size();
+	const size_t elementCount = m_elements.size();
+	// node -> element incidence
+	Array<size_t> incidencePtr(nodeCount + 1, 0);
+	for (const auto& elem : m_elements)
+		for (int a = 0; a < N_NODES; a++)
+			incidencePtr[elem.nodeIdx(a) + 1]++;
+	for (size_t i = 0; i < nodeCount; i++)
+		incidencePtr[i + 1] += incidencePtr[i];
+	Array<size_t> incidence(incidencePtr[nodeCount]);
+	Array<size_t> fill(incidencePtr);
+	for (size_t e = 0; e < elementCount; e++)
+		for (int a = 0; a < N_NODES; a++)
+			incidence[fill[m_elements[e].nodeIdx(a)]++] = e;
+	// greedy coloring, smallest color not used by any element sharing a node
+	const size_t uncolored = std::numeric_limits<size_t>::max();
+	Array<size_t> colors(elementCount, uncolored);
+	Array<size_t> usedBy; // usedBy[color] == e if a neighbour of e has that color
+	size_t colorCount = 0;
+	for (size_t e = 0; e < elementCount; e++)
+	{
+		for (int a = 0; a < N_NODES; a++)
+		{
+			size_t n = m_elements[e].nodeIdx(a);
+			for (size_t k = incidencePtr[n]; k < incidencePtr[n + 1]; k++)
+				if (colors[incidence[k]] != uncolored)
+					usedBy[colors[incidence[k]]] = e;
+		}
+		size_t color = 0;
+		while (color < colorCount && usedBy[color] == e)
+			color++;
+		if (color == colorCount)
+		{
+			usedBy.pushBack(uncolored);
+			colorCount++;
+		}
+		colors[e] = color;
+	}
+	// group elements by color, keeping the element order within a color
+	m_colorPtr = Array<size_t>(colorCount + 1, 0);
+	for (size_t e = 0; e < elementCount; e++)
+		m_colorPtr[colors[e] + 1]++;
+	for (size_t c = 0; c < colorCount; c++)
+		m_colorPtr[c + 1] += m_colorPtr[c];
+	m_coloredElements = Array<size_t>(elementCount);
+	fill = m_colorPtr;
+	for (size_t e = 0; e < elementCount; e++)
+		m_coloredElements[fill[colors[e]]++] = e;
+}
@@ -1,15 +1,17 @@
 #pragma once
 #include "data_structures/StaticArray.hpp"
 #include "geometry/Point.hpp"
-#include "math/Polynomial.hpp"
+#include "math/StaticPolynomial.hpp"
 #include "math/Vector.hpp"
 #include "math/Matrix.hpp"
 #include "FiniteElement.hpp"
+#include "ReferenceTables.hpp"
 
 // forward declaration
 template <typename T, int N_NODES>
 class Mesh;
 
+// shape functions and reference integrals come from the constexpr tables, the element itself is stateless
 template <typename T, int N_NODES>
 class ReferenceElement
 {
@@ -19,12 +21,20 @@ public:
 		Mat2 JinvT; // jacobian tranpose inverse
 		double absDetJ; // absolute value of the determinant of  the jacobian
 	};
+	// coeff * |det J| * JinvT^T * JinvT, the stiffness matrix is its contraction with the gradient integrals
+	struct Metric
+	{
+		T c00;
+		T c01;
+		T c11;
+	};
+	using Shape = ReferenceShape<T, N_NODES>;
+	static constexpr size_t ORDER = Shape::ORDER; // polynomial order of the shape functions
+	using ShapeFunction = typename Shape::ShapeFunction; // N(x, y), no allocation
 private:
-	StaticArray<Point, N_NODES> m_positions;
-	StaticArray<Polynomial<Polynomial<T>>, N_NODES> m_shapeFunctions;
-	StaticArray<Vector<Polynomial<Polynomial<T>>, 2>, N_NODES> m_gradients;
+	static constexpr const ReferenceTables<T, N_NODES>& TABLES = referenceTables<T, N_NODES>;
 public:
-	ReferenceElement();
+	ReferenceElement() = default;
 	~ReferenceElement() = default;
 	ReferenceElement(const ReferenceElement&) = delete;
 	ReferenceElement(ReferenceElement&&) = delete;
@@ -32,69 +42,37 @@ public:
 	ReferenceElement& operator=(ReferenceElement&&) = delete;
 
 	const auto& shapeFunctions() const;
-	const auto& gradients() const;
+	const auto& gradients() const; // gradients()[i][a] = dNi/dxa
 	Mapping mapping(const FiniteElement<N_NODES>& element, const Mesh<T, N_NODES>& mesh) const;
-};
-
-// linear element
-template<typename T, int N_NODES>
-inline ReferenceElement<T, N_NODES>::ReferenceElement()
-{
-	if constexpr (N_NODES == 3)
-	{
-		// positions
-		m_positions[0] = Point{ 0.0, 0.0 };
-		m_positions[1] = Point{ 1.0, 0.0 };
-		m_positions[2] = Point{ 0.0, 1.0 };
 
-		// hleper inner polynomials of x
-		Polynomial<T> zero{ T{0.0} };
-		Polynomial<T> x{ T{0.0}, T{1.0} };
-		Polynomial<T> minusX{ T{0.0}, T{-1.0} };
-		Polynomial<T> one{ T{1.0} };
-		Polynomial<T> oneMinusX{ T{1.0}, T{-1.0} };
-		// corresponding shape functions
-		for (auto& n : m_shapeFunctions)
-		{
-			n.resizeCoefficients(2);
-		}
-		// n0 = 1-x-y
-		m_shapeFunctions[0][0] = oneMinusX;
-		m_shapeFunctions[0][1] = -one;
-		// n1 = x
-		m_shapeFunctions[1][0] = x;
-		m_shapeFunctions[1][1] = zero;
-		// n2 = y
-		m_shapeFunctions[2][0] = zero;
-		m_shapeFunctions[2][1] = one;
-		// gradients
-		for (int i = 0; i < 3; i++)
-		{
-			m_gradients[i] = gradient(m_shapeFunctions[i]);
-		}
-	}
-	else
-	{
-		static_assert(false, "Unsuppeorted element type (incorrect N_NODES in ReferenceElement)\n");
-	}
-}
+	static constexpr T gradientIntegral(int i, int j, int a, int b);
+	static constexpr T massIntegral(int i, int j);
+	static Metric metric(const Mapping& mapping, T coeff);
+	// coeff * int grad Ni . grad Nj over the mapped element (row major)
+	void stiffnessMatrix(const Mapping& mapping, T coeff, StaticArray<T, N_NODES * N_NODES>& K) const;
+	void stiffnessMatrix(const Metric& C, StaticArray<T, N_NODES * N_NODES>& K) const;
+	// int f * Ni over the mapped element, f interpolated from its nodal values
+	void loadVector(const Mapping& mapping, const StaticArray<T, N_NODES>& nodalSource, StaticArray<T, N_NODES>& f) const;
+	void loadVector(T absDetJ, const StaticArray<T, N_NODES>& nodalSource, StaticArray<T, N_NODES>& f) const;
+};
 
 template<typename T, int N_NODES>
 inline const auto& ReferenceElement<T, N_NODES>::shapeFunctions() const
 {
-	return m_shapeFunctions;
+	return Shape::shapeFunctions;
 }
 
 template<typename T, int N_NODES>
 inline const auto& ReferenceElement<T, N_NODES>::gradients() const
 {
-	return m_gradients;
+	return TABLES.gradients;
 }
 
 template<typename T, int N_NODES>
 inline typename ReferenceElement<T, N_NODES>::Mapping ReferenceElement<T, N_NODES>::mapping(const FiniteElement<N_NODES>& element, const Mesh<T, N_NODES>& mesh) const
 {
-	if constexpr (N_NODES == 3)
+	// straight sided elements, the map is affine and given by the vertex nodes 0, 1, 2
+	if constexpr (N_NODES == 3 || N_NODES == 6)
 	{
 		const Point& p0 = mesh.node(element.nodeIdx(0)).position();
 		const Point& p1 = mesh.node(element.nodeIdx(1)).position();
@@ -104,7 +82,71 @@ inline typename ReferenceElement<T, N_NODES>::Mapping ReferenceElement<T, N_NODE
 	}
 	else
 	{
-		static_assert(false, "Unsuppeorted element type (incorrect N_NODES in ReferenceElement mapping)\n");
+		static_assert(sizeof(T) == 0, "Unsupported element type (incorrect N_NODES in ReferenceElement mapping)\n");
 	}
 	return Mapping{};
 }
+
+template<typename T, int N_NODES>
+inline constexpr T ReferenceElement<T, N_NODES>::gradientIntegral(int i, int j, int a, int b)
+{
+	return TABLES.gradientIntegrals[((i * N_NODES + j) * 2 + a) * 2 + b];
+}
+
+template<typename T, int N_NODES>
+inline constexpr T ReferenceElement<T, N_NODES>::massIntegral(int i, int j)
+{
+	return TABLES.massIntegrals[i * N_NODES + j];
+}
+
+template<typename T, int N_NODES>
+inline typename ReferenceElement<T, N_NODES>::Metric ReferenceElement<T, N_NODES>::metric(const Mapping& mapping, T coeff)
+{
+	// grad N = JinvT * gradRef N, so grad Ni . grad Nj = gradRef Ni^T * C * gradRef Nj with C = JinvT^T * JinvT
+	const Mat2& B = mapping.JinvT;
+	const T scale = coeff * mapping.absDetJ;
+	return {
+		scale * (B[0][0] * B[0][0] + B[1][0] * B[1][0]),
+		scale * (B[0][0] * B[0][1] + B[1][0] * B[1][1]),
+		scale * (B[0][1] * B[0][1] + B[1][1] * B[1][1])
+	};
+}
+
+template<typename T, int N_NODES>
+inline void ReferenceElement<T, N_NODES>::stiffnessMatrix(const Mapping& mapping, T coeff, StaticArray<T, N_NODES * N_NODES>& K) const
+{
+	stiffnessMatrix(metric(mapping, coeff), K);
+}
+
+template<typename T, int N_NODES>
+inline void ReferenceElement<T, N_NODES>::stiffnessMatrix(const Metric& C, StaticArray<T, N_NODES * N_NODES>& K) const
+{
+	for (int i = 0; i < N_NODES; i++)
+	{
+		for (int j = i; j < N_NODES; j++)
+		{
+			const T* S = TABLES.gradientIntegrals + (i * N_NODES + j) * 4;
+			T value = C.c00 * S[0] + C.c01 * (S[1] + S[2]) + C.c11 * S[3];
+			K[i * N_NODES + j] = value;
+			K[j * N_NODES + i] = value;
+		}
+	}
+}
+
+template<typename T, int N_NODES>
+inline void ReferenceElement<T, N_NODES>::loadVector(const Mapping& mapping, const StaticArray<T, N_NODES>& nodalSource, StaticArray<T, N_NODES>& f) const
+{
+	loadVector(mapping.absDetJ, nodalSource, f);
+}
+
+template<typename T, int N_NODES>
+inline void ReferenceElement<T, N_NODES>::loadVector(T absDetJ, const StaticArray<T, N_NODES>& nodalSource, StaticArray<T, N_NODES>& f) const
+{
+	for (int i = 0; i < N_NODES; i++)
+	{
+		T value{};
+		for (int j = 0; j < N_NODES; j++)
+			value += TABLES.massIntegrals[i * N_NODES + j] * nodalSource[j];
+		f[i] = value * absDetJ;
+	}
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include "math/StaticPolynomial.hpp"
+
+// compile time data of the reference elements
+// a new element type only specialises ReferenceShape, the tables follow from its shape functions
+
+// shape functions on the reference triangle (0,0), (1,0), (0,1), specialised on the node count
+template <typename T, int N_NODES>
+struct ReferenceShape
+{
+	static_assert(sizeof(T) == 0, "Unsupported element type (incorrect N_NODES in ReferenceShape)\n");
+};
+
+// linear element
+template <typename T>
+struct ReferenceShape<T, 3>
+{
+	static constexpr size_t ORDER = 1;
+	using ShapeFunction = StaticPolynomial<T, ORDER, 2>;
+	static constexpr T positions[3][2] = { { 0.0, 0.0 }, { 1.0, 0.0 }, { 0.0, 1.0 } };
+	static constexpr ShapeFunction shapeFunctions[3] = {
+		T(1) - ShapeFunction::variable(0) - ShapeFunction::variable(1), // n0 = 1-x-y
+		ShapeFunction::variable(0), // n1 = x
+		ShapeFunction::variable(1) // n2 = y
+	};
+};
+
+// quadratic element, nodes 3, 4, 5 at the midpoints of edges 0-1, 1-2, 2-0
+// written in the barycentric coordinates Li, which are the linear shape functions
+template <typename T>
+struct ReferenceShape<T, 6>
+{
+	static constexpr size_t ORDER = 2;
+	using ShapeFunction = StaticPolynomial<T, ORDER, 2>;
+	using Linear = ReferenceShape<T, 3>;
+	static constexpr T positions[6][2] = { { 0.0, 0.0 }, { 1.0, 0.0 }, { 0.0, 1.0 }, { 0.5, 0.0 }, { 0.5, 0.5 }, { 0.0, 0.5 } };
+	static constexpr ShapeFunction shapeFunctions[6] = {
+		Linear::shapeFunctions[0] * (T(2) * Linear::shapeFunctions[0] - T(1)), // n0 = L0(2L0-1)
+		Linear::shapeFunctions[1] * (T(2) * Linear::shapeFunctions[1] - T(1)), // n1 = L1(2L1-1)
+		Linear::shapeFunctions[2] * (T(2) * Linear::shapeFunctions[2] - T(1)), // n2 = L2(2L2-1)
+		T(4) * (Linear::shapeFunctions[0] * Linear::shapeFunctions[1]), // n3 = 4L0L1
+		T(4) * (Linear::shapeFunctions[1] * Linear::shapeFunctions[2]), // n4 = 4L1L2
+		T(4) * (Linear::shapeFunctions[2] * Linear::shapeFunctions[0]) // n5 = 4L2L0
+	};
+};
+
+template <typename T, int N_NODES>
+struct ReferenceTables
+{
+	using ShapeFunction = typename ReferenceShape<T, N_NODES>::ShapeFunction;
+	ShapeFunction gradients[N_NODES][2];
+	T centroidGradients[N_NODES][2]; // gradients at (1/3, 1/3)
+	T gradientIntegrals[N_NODES * N_NODES * 4]; // int dNi/dxa * dNj/dxb
+	T massIntegrals[N_NODES * N_NODES]; // int Ni * Nj
+};
+
+template <typename T, int N_NODES>
+inline constexpr ReferenceTables<T, N_NODES> makeReferenceTables()
+{
+	using Shape = ReferenceShape<T, N_NODES>;
+	ReferenceTables<T, N_NODES> tables{};
+	for (int i = 0; i < N_NODES; i++)
+	{
+		for (size_t a = 0; a < 2; a++)
+		{
+			tables.gradients[i][a] = Shape::shapeFunctions[i].derivative(a);
+			tables.centroidGradients[i][a] = tables.gradients[i][a](T(1) / T(3), T(1) / T(3));
+		}
+	}
+	for (int i = 0; i < N_NODES; i++)
+	{
+		for (int j = 0; j < N_NODES; j++)
+		{
+			for (int a = 0; a < 2; a++)
+				for (int b = 0; b < 2; b++)
+					tables.gradientIntegrals[((i * N_NODES + j) * 2 + a) * 2 + b] = integral(tables.gradients[i][a] * tables.gradients[j][b]);
+			tables.massIntegrals[i * N_NODES + j] = integral(Shape::shapeFunctions[i] * Shape::shapeFunctions[j]);
+		}
+	}
+	return tables;
+}
+
+// evaluated by the compiler, kernels reading it see immediate constants
+template <typename T, int N_NODES>
+inline constexpr ReferenceTables<T, N_NODES> referenceTables = makeReferenceTables<T, N_NODES>();
@@ -1,40 +1,87 @@
 #pragma once
+#include <cassert>
 #include <limits>
+#include <memory>
+#include <stdexcept>
 #include "Mesh.hpp"
 #include "MaterialManager.hpp"
 #include "BoundaryConditionManager.hpp"
-#include "sparse/Matrix.hpp"
+#include "sparse/CSRMatrix.hpp"
+#include "sparse/DiffusionOperator.hpp"
 #include "sparse/Vector.hpp"
+#include "sparse/ConjugateGradient.hpp"
+#include "sparse/Preconditioner.hpp"
+#include "sparse/JacobiPreconditioner.hpp"
+#include "sparse/SSORPreconditioner.hpp"
+#include "sparse/IncompleteCholesky.hpp"
+#include "sparse/AMGPreconditioner.hpp"
 #include "geometry/Triangulation.hpp"
 #include "geometry/Point.hpp"
 
 class Solver
 {
-	using Matrix = sparse::Matrix<double>;
+	using Matrix = sparse::CSRMatrix<double>;
 	using Vector = sparse::Vector<double>;
+public:
+	enum class PreconditionerType;
+	enum class OperatorType;
+	// 3 - linear, 6 - quadratic triangles (about 4x the DOFs on the same mesh, use with a coarser sampling)
+	static constexpr int ELEMENT_NODES = 3;
 private:
-	Mesh<double, 3> m_mesh;
+	Mesh<double, ELEMENT_NODES> m_mesh;
 	MaterialManager<double> m_materialManager;
 	BoundaryConditionManager<double> m_bcManager;
-	Matrix m_systemMatrix;
+	OperatorType m_operatorType;
+	// only the operator of m_operatorType exists
+	std::unique_ptr<Matrix> m_systemMatrix;
+	std::unique_ptr<sparse::DiffusionOperator<double, ELEMENT_NODES>> m_operator;
 	Vector m_solution;
 	Vector m_rhs;
+	PreconditionerType m_preconditionerType;
+	std::unique_ptr<sparse::Preconditioner<double>> m_preconditioner;
+	sparse::ConjugateGradient<double> m_cg;
 public:
-	Solver(const Triangulation& triangulation);
+	Solver(const Triangulation& triangulation); // assembled operator
+	Solver(const Triangulation& triangulation, OperatorType operatorType);
 	~Solver() = default;
 	Solver(const Solver&) = delete;
 	Solver(Solver&&) = delete;
 	Solver& operator=(const Solver&) = delete;
 	Solver& operator=(Solver&&) = delete;
 	void conjugateGradient();
+	void setPreconditioner(PreconditionerType type); // throws if the type needs the assembled matrix but there is none
 	void getVertices(Array<Point>& vertices) const;
 	void getIndices(Array<uint32_t>& indices) const;
 	void getSolution(Array<double>& solution) const;
+	void getGradients(Array<Point>& gradients) const; // at the element centroids
 private:
 	void applyDirichletBC();
+	void createPreconditioner();
+	static bool needsAssembledMatrix(PreconditionerType type);
+};
+
+enum class Solver::PreconditionerType
+{
+	NONE,
+	JACOBI,
+	SSOR,
+	INCOMPLETE_CHOLESKY,
+	AMG
+};
+
+enum class Solver::OperatorType
+{
+	ASSEMBLED, // CSR stiffness matrix, any preconditioner
+	MATRIX_FREE // stiffness applied element by element for meshes whose matrix does not fit in memory, JACOBI or NONE only
 };
 
-Solver::Solver(const Triangulation& triangulation) : m_mesh(triangulation)
+Solver::Solver(const Triangulation& triangulation) : Solver(triangulation, OperatorType::ASSEMBLED)
+{
+}
+
+Solver::Solver(const Triangulation& triangulation, OperatorType operatorType) :
+	m_mesh(triangulation), m_operatorType(operatorType),
+	m_preconditionerType(operatorType == OperatorType::MATRIX_FREE ? PreconditionerType::JACOBI : PreconditionerType::AMG)
 {
 	m_materialManager.addMaterial({ 1.0 });
 
@@ -79,8 +126,19 @@ Solver::Solver(const Triangulation& triangulation) : m_mesh(triangulation)
 
 	// source term (rhs of PDE)
 	std::function<double(const Point& p)> source = [](const Point& p) {return 0.0; };
-	m_systemMatrix.assemble(m_mesh, m_materialManager, m_bcManager, m_rhs, source);
-	//m_systemMatrix.print();
+	if (m_operatorType == OperatorType::MATRIX_FREE)
+	{
+		m_operator = std::make_unique<sparse::DiffusionOperator<double, ELEMENT_NODES>>();
+		m_operator->assemble(m_mesh, m_materialManager, m_rhs, source);
+	}
+	else
+	{
+		// symbolic phase (sparsity pattern) once per mesh, numeric phase whenever coefficients change
+		m_systemMatrix = std::make_unique<Matrix>();
+		m_systemMatrix->buildPattern(m_mesh);
+		m_systemMatrix->assemble(m_mesh, m_materialManager, m_rhs, source);
+	}
+	//m_systemMatrix->print();
 	applyDirichletBC();
 	conjugateGradient();
 }
@@ -89,55 +147,27 @@ inline void Solver::conjugateGradient()
 {
 	const size_t nodeCount = m_mesh.nodeCount();
 	m_solution.resize(nodeCount);
-	// residual
-	sparse::Vector<double> r = m_rhs - m_systemMatrix * m_solution;
-	sparse::Vector<double> prevR(r.dim());
-	// searchh direction 
-	sparse::Vector<double> p = r;
-	double rNormSq = dot(r, r);
-	double rNormSqInitial = rNormSq;
-	std::cout << "Initial residual magnitude squared = " << rNormSq << "\n";
-	if (std::sqrt(rNormSq) < 1e-24)
-	{
-		std::cout << "Inintial guess is alraedy the solution\n";
-		return;
-	}
-	// counter to prevent infinite loop
-	int iterations = 0;
-	// step size
-	double alpha = 0.0;
-	// improvement factor
-	double beta = 0.0;
-	// A*p product
-	sparse::Vector<double> Ap(m_rhs.dim());
-	const double toleranceSq = 1e-12;
-	const double absToleranceSq = 1e-12;
-	const double relToleranceSq = 1e-12 * normSq(m_rhs);
-	const size_t maxIterations = 10000;
-
-	for(size_t k = 0; k < maxIterations; k++)
-	{
-		// precomputin A*p product
-		Ap = m_systemMatrix * p;
-		// step size
-		alpha = dot(r, r) / (dot(p, Ap));
-		// update solution
-		m_solution = m_solution + alpha * p;
-		// update residual
-		prevR = r;
-		r = r - alpha * (Ap);
-		rNormSq = dot(r, r);
-		if (std::sqrt(rNormSq) < absToleranceSq + relToleranceSq)
-		{
-			std::cout << "CG converged in " << k << " iterations\n";
-			return;
-		}
-		// improvement factor
-		beta = rNormSq / dot(prevR, prevR);
-		// update search direction
-		p = r + beta * p;
-	}
-	std::cout << "CG failed to converge within " << maxIterations << " iterations\n";
+	if (!m_preconditioner)
+		createPreconditioner();
+	// iteration count grows with the mesh size
+	m_cg.setMaxIterations(std::max<size_t>(10000, nodeCount));
+	bool converged;
+	if (m_operatorType == OperatorType::MATRIX_FREE)
+		converged = m_cg.solve(*m_operator, m_rhs, m_solution, *m_preconditioner);
+	else
+		converged = m_cg.solve(*m_systemMatrix, m_rhs, m_solution, *m_preconditioner);
+	if (converged)
+		std::cout << "CG converged in " << m_cg.iterations() << " iterations\n";
+	else
+		std::cout << "CG failed to converge within " << m_cg.maxIterations() << " iterations\n";
+}
+
+inline void Solver::setPreconditioner(PreconditionerType type)
+{
+	if (m_operatorType == OperatorType::MATRIX_FREE && needsAssembledMatrix(type))
+		throw std::invalid_argument("Solver: the preconditioner needs the assembled matrix, use JACOBI or NONE with the matrix-free operator");
+	m_preconditionerType = type;
+	m_preconditioner = nullptr; // rebuilt on next solve
 }
 
 inline void Solver::getVertices(Array<Point>& vertices) const
@@ -153,12 +183,25 @@ inline void Solver::getVertices(Array<Point>& vertices) const
 inline void Solver::getIndices(Array<uint32_t>& indices) const
 {
 	size_t elementCount = m_mesh.elementCount();
-	indices.resize(elementCount * 3);
-	for (size_t i = 0; i < elementCount; i++)
+	if constexpr (ELEMENT_NODES == 6)
 	{
-		indices[i * 3 + 0] = static_cast<unsigned int>(m_mesh.element(i).nodeIdx(0));
-		indices[i * 3 + 1] = static_cast<unsigned int>(m_mesh.element(i).nodeIdx(1));
-		indices[i * 3 + 2] = static_cast<unsigned int>(m_mesh.element(i).nodeIdx(2));
+		// quadratic elements are drawn as 4 linear sub-triangles through the mid-edge nodes
+		const int subTriangles[4][3] = { { 0, 3, 5 }, { 3, 1, 4 }, { 5, 4, 2 }, { 3, 4, 5 } };
+		indices.resize(elementCount * 12);
+		for (size_t i = 0; i < elementCount; i++)
+			for (int t = 0; t < 4; t++)
+				for (int k = 0; k < 3; k++)
+					indices[i * 12 + t * 3 + k] = static_cast<unsigned int>(m_mesh.element(i).nodeIdx(subTriangles[t][k]));
+	}
+	else
+	{
+		indices.resize(elementCount * 3);
+		for (size_t i = 0; i < elementCount; i++)
+		{
+			indices[i * 3 + 0] = static_cast<unsigned int>(m_mesh.element(i).nodeIdx(0));
+			indices[i * 3 + 1] = static_cast<unsigned int>(m_mesh.element(i).nodeIdx(1));
+			indices[i * 3 + 2] = static_cast<unsigned int>(m_mesh.element(i).nodeIdx(2));
+		}
 	}
 }
 
@@ -172,44 +215,67 @@ inline void Solver::getSolution(Array<double>& solution) const
 	}
 }
 
+inline void Solver::getGradients(Array<Point>& gradients) const
+{
+	m_mesh.centroidGradients(m_solution, gradients);
+}
+
 inline void Solver::applyDirichletBC()
 {
 	size_t nodeCount = m_mesh.nodeCount();
-	// modify RHS
+	// boundary values of fixed nodes
+	Array<bool> isFixed(nodeCount, false);
+	Vector fixedValues(nodeCount);
 	for (size_t i = 0; i < nodeCount; i++)
 	{
 		const Node& node = m_mesh.node(i);
 		const int boundaryId = node.boundaryId(); // assumming only 1  bc per node
 		if (boundaryId > -1)
 		{
-			// boundary value
-			double g_i = m_bcManager.getBC(boundaryId).getValue(node.position());
-			// update rhs vector F_j = F_j - K_ij * g_i
-			for (size_t j = 0; j < nodeCount; j++)
-			{
-				if (i == j)
-					continue; // boundary row value will be set explicitly
-				double K_ji = m_systemMatrix.getValue(j, i);
-				if (K_ji != 0.0)
-				{
-					m_rhs[j] -= K_ji * g_i;
-				}
-			}
+			isFixed[i] = true;
+			fixedValues[i] = m_bcManager.getBC(boundaryId).getValue(node.position());
 		}
 	}
-	// modify stiffness matrix and set boundary vzlues in rhs
-	for (size_t i = 0; i < nodeCount; i++)
+	if (m_operatorType == OperatorType::MATRIX_FREE)
 	{
-		const Node& node = m_mesh.node(i);
-		const int boundaryId = node.boundaryId(); // assumming only 1  bc per node
-		if (boundaryId > -1)
-		{
-			// modify matrix
-			m_systemMatrix.zeroColumn(i);
-			m_systemMatrix.setRowIdentity(i);
-			// boundary value
-			double g_i = m_bcManager.getBC(boundaryId).getValue(node.position());
-			m_rhs[i] = g_i;
-		}
+		m_operator->applyDirichlet(isFixed, fixedValues, m_rhs);
+	}
+	else
+	{
+		// modify stiffness matrix and rhs touching only the stored nonzeros
+		m_systemMatrix->applyDirichlet(isFixed, fixedValues, m_rhs);
 	}
 }
+
+inline void Solver::createPreconditioner()
+{
+	// setPreconditioner keeps the matrix-free operator to the types below without a matrix
+	assert(m_systemMatrix || !needsAssembledMatrix(m_preconditionerType));
+	switch (m_preconditionerType)
+	{
+	case PreconditionerType::JACOBI:
+		if (m_operatorType == OperatorType::MATRIX_FREE)
+			m_preconditioner = std::make_unique<sparse::JacobiPreconditioner<double>>(m_operator->diagonal());
+		else
+			m_preconditioner = std::make_unique<sparse::JacobiPreconditioner<double>>(*m_systemMatrix);
+		break;
+	case PreconditionerType::SSOR:
+		m_preconditioner = std::make_unique<sparse::SSORPreconditioner<double>>(*m_systemMatrix, 1.5);
+		break;
+	case PreconditionerType::INCOMPLETE_CHOLESKY:
+		m_preconditioner = std::make_unique<sparse::IncompleteCholesky<double>>(*m_systemMatrix);
+		break;
+	case PreconditionerType::AMG:
+		m_preconditioner = std::make_unique<sparse::AMGPreconditioner<double>>(*m_systemMatrix);
+		break;
+	default:
+		m_preconditioner = std::make_unique<sparse::IdentityPreconditioner<double>>();
+		break;
+	}
+}
+
+inline bool Solver::needsAssembledMatrix(PreconditionerType type)
+{
+	return type == PreconditionerType::SSOR || type == PreconditionerType::INCOMPLETE_CHOLESKY
+		|| type == PreconditionerType::AMG;
+}
@@ -0,0 +1,118 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <random>
+#include "data_structures/Array.hpp"
+#include "geometry/Point.hpp"
+#include "geometry/Triangulation.hpp"
+#include "Mesh.hpp"
+#include "MaterialManager.hpp"
+#include "sparse/CSRMatrix.hpp"
+#include "sparse/DiffusionOperator.hpp"
+#include "sparse/Vector.hpp"
+
+// consistency checks of the solver kernels on a given triangulation,
+// run by the executable with --check instead of opening the window
+namespace checks
+{
+inline bool report(const char* name, double error, double tolerance)
+{
+	const bool passed = error <= tolerance;
+	std::cout << name << ": max error " << error << (passed ? " - passed\n" : " - FAILED\n");
+	return passed;
+}
+
+// the gradients of u = 1 + 2x - 3y (in the space of P1 and P2) must be exact in every element
+template<int N_NODES>
+bool linearFieldGradients(const Triangulation& triangulation)
+{
+	Mesh<double, N_NODES> mesh(triangulation);
+	Array<double> linear(mesh.nodeCount());
+	for (size_t i = 0; i < mesh.nodeCount(); i++)
+	{
+		const Point& p = mesh.node(i).position();
+		linear[i] = 1.0 + 2.0 * p[0] - 3.0 * p[1];
+	}
+	Array<Point> gradients;
+	mesh.centroidGradients(linear, gradients);
+	double error = 0.0;
+	for (const auto& gradient : gradients)
+		error = std::max({ error, std::abs(gradient[0] - 2.0), std::abs(gradient[1] + 3.0) });
+	return report(N_NODES == 3 ? "P1 centroid gradients of a linear field" : "P2 centroid gradients of a linear field",
+		error, 1e-9);
+}
+
+// DiffusionOperator::apply must match CSRMatrix::apply, before and after the Dirichlet rows
+// and columns are fixed, relative to the largest entry of the product
+template<int N_NODES>
+bool matrixFreeApply(const Triangulation& triangulation)
+{
+	Mesh<double, N_NODES> mesh(triangulation);
+	MaterialManager<double> materialManager;
+	materialManager.addMaterial({ 1.0 });
+	const std::function<double(const Point&)> source = [](const Point& p) { return 1.0 + p[0] * p[1]; };
+	const size_t nodeCount = mesh.nodeCount();
+	sparse::CSRMatrix<double> matrix;
+	sparse::Vector<double> matrixRhs;
+	matrix.buildPattern(mesh);
+	matrix.assemble(mesh, materialManager, matrixRhs, source);
+	sparse::DiffusionOperator<double, N_NODES> matrixFree;
+	sparse::Vector<double> matrixFreeRhs;
+	matrixFree.assemble(mesh, materialManager, matrixFreeRhs, source);
+
+	std::mt19937 engine; // default seeded, the same vector on every run
+	std::uniform_real_distribution<double> distribution(-1.0, 1.0);
+	sparse::Vector<double> x(nodeCount);
+	for (size_t i = 0; i < nodeCount; i++)
+		x[i] = distribution(engine);
+	sparse::Vector<double> y(nodeCount);
+	sparse::Vector<double> yMatrixFree(nodeCount);
+	auto relativeError = [&]()
+		{
+			matrix.apply(x, y);
+			matrixFree.apply(x, yMatrixFree);
+			double largest = 0.0;
+			double error = 0.0;
+			for (size_t i = 0; i < nodeCount; i++)
+			{
+				largest = std::max(largest, std::abs(y[i]));
+				error = std::max(error, std::abs(y[i] - yMatrixFree[i]));
+			}
+			return error / largest;
+		};
+	double error = relativeError();
+	// boundary nodes fixed to their x coordinate
+	Array<bool> isFixed(nodeCount, false);
+	sparse::Vector<double> fixedValues(nodeCount);
+	for (size_t i = 0; i < nodeCount; i++)
+	{
+		isFixed[i] = mesh.node(i).boundaryId() > -1;
+		fixedValues[i] = mesh.node(i).position()[0];
+	}
+	matrix.applyDirichlet(isFixed, fixedValues, matrixRhs);
+	matrixFree.applyDirichlet(isFixed, fixedValues, matrixFreeRhs);
+	error = std::max(error, relativeError());
+	double largestRhs = 0.0;
+	double rhsError = 0.0;
+	for (size_t i = 0; i < nodeCount; i++)
+	{
+		largestRhs = std::max(largestRhs, std::abs(matrixRhs[i]));
+		rhsError = std::max(rhsError, std::abs(matrixRhs[i] - matrixFreeRhs[i]));
+	}
+	error = std::max(error, rhsError / largestRhs);
+	return report(N_NODES == 3 ? "P1 matrix-free apply against the CSR matrix" : "P2 matrix-free apply against the CSR matrix",
+		error, 1e-12);
+}
+
+inline bool run(const Triangulation& triangulation)
+{
+	bool passed = true;
+	passed = linearFieldGradients<3>(triangulation) && passed;
+	passed = linearFieldGradients<6>(triangulation) && passed;
+	passed = matrixFreeApply<3>(triangulation) && passed;
+	passed = matrixFreeApply<6>(triangulation) && passed;
+	return passed;
+}
+}
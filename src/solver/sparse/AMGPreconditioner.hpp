@@ -0,0 +1,427 @@
+#pragma once
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include "data_structures/Array.hpp"
+#include "CSRMatrix.hpp"
+#include "Preconditioner.hpp"
+#include "Vector.hpp"
+
+namespace sparse
+{
+// smoothed aggregation algebraic multigrid, applied as one symmetric V-cycle
+// (forward Gauss-Seidel pre-smoothing, backward Gauss-Seidel post-smoothing,
+// dense Cholesky on the coarsest level, or symmetric Gauss-Seidel sweeps when
+// coarsening stopped above maxCoarseSize)
+// the hierarchy (aggregates and prolongators) is built once per matrix pattern and
+// kept between solves, update() only recomputes the Galerkin coarse operators
+template<typename T>
+class AMGPreconditioner : public Preconditioner<T>
+{
+private:
+	struct Level;
+	const CSRMatrix<T>* m_fineMatrix; // must outlive the preconditioner
+	Array<Level> m_levels;
+	Array<T> m_coarseFactor; // dense lower Cholesky factor of the coarsest operator, empty if too large
+	T m_strengthThreshold;
+	size_t m_maxCoarseSize;
+	size_t m_maxLevels;
+	int m_smoothingSweeps;
+	static constexpr size_t NO_AGGREGATE = std::numeric_limits<size_t>::max();
+	static constexpr int COARSE_SMOOTHING_SWEEPS = 10; // without a direct coarse solve
+public:
+	explicit AMGPreconditioner(const CSRMatrix<T>& A, T strengthThreshold = T{ 0.08 },
+		size_t maxCoarseSize = 200, size_t maxLevels = 12, int smoothingSweeps = 1);
+	void apply(const Vector<T>& r, Vector<T>& z) const override;
+	void update(const CSRMatrix<T>& A); // same pattern, new coefficients
+	size_t levelCount() const;
+	size_t rows(size_t level) const;
+	T operatorComplexity() const;
+private:
+	const CSRMatrix<T>& matrix(size_t level) const;
+	void build();
+	void computeGalerkinOperators();
+	void setupLevels(); // diagonals, workspace and coarse solve of the current operators
+	size_t aggregate(const CSRMatrix<T>& A, Array<size_t>& aggregates) const;
+	CSRMatrix<T> smoothedProlongator(const CSRMatrix<T>& A, const Array<size_t>& aggregates, size_t aggregateCount) const;
+	T spectralRadiusEstimate(const CSRMatrix<T>& A) const; // of D^-1 * A
+	void factorizeCoarsest();
+	void solveCoarsest(const Vector<T>& b, Vector<T>& x) const;
+	void vCycle(size_t level, const Vector<T>& b, Vector<T>& x) const;
+	void gaussSeidel(size_t level, const Vector<T>& b, Vector<T>& x, bool forward) const;
+};
+
+template<typename T>
+struct AMGPreconditioner<T>::Level
+{
+	CSRMatrix<T> A; // owned operator (empty on the finest level)
+	CSRMatrix<T> P; // prolongation from the next coarser level
+	CSRMatrix<T> R; // restriction, P^T
+	Array<T> invDiagonal;
+	// V-cycle workspace
+	mutable Vector<T> residual;
+	mutable Vector<T> coarseRhs;
+	mutable Vector<T> coarseCorrection;
+};
+
+template<typename T>
+inline AMGPreconditioner<T>::AMGPreconditioner(const CSRMatrix<T>& A, T strengthThreshold,
+	size_t maxCoarseSize, size_t maxLevels, int smoothingSweeps) :
+	m_fineMatrix(&A), m_strengthThreshold(strengthThreshold),
+	m_maxCoarseSize(maxCoarseSize), m_maxLevels(maxLevels), m_smoothingSweeps(smoothingSweeps)
+{
+	build();
+}
+
+template<typename T>
+inline void AMGPreconditioner<T>::apply(const Vector<T>& r, Vector<T>& z) const
+{
+	if (z.dim() != r.dim())
+		z.resize(r.dim());
+	vCycle(0, r, z);
+}
+
+template<typename T>
+inline void AMGPreconditioner<T>::update(const CSRMatrix<T>& A)
+{
+	assert(A.rows() == m_fineMatrix->rows());
+	m_fineMatrix = &A;
+	computeGalerkinOperators();
+}
+
+template<typename T>
+inline size_t AMGPreconditioner<T>::levelCount() const
+{
+	return m_levels.size();
+}
+
+template<typename T>
+inline size_t AMGPreconditioner<T>::rows(size_t level) const
+{
+	return matrix(level).rows();
+}
+
+template<typename T>
+inline T AMGPreconditioner<T>::operatorComplexity() const
+{
+	size_t nnz = 0;
+	for (size_t l = 0; l < m_levels.size(); l++)
+		nnz += matrix(l).nonZeros();
+	return static_cast<T>(nnz) / static_cast<T>(m_fineMatrix->nonZeros());
+}
+
+template<typename T>
+inline const CSRMatrix<T>& AMGPreconditioner<T>::matrix(size_t level) const
+{
+	return level == 0 ? *m_fineMatrix : m_levels[level].A;
+}
+
+template<typename T>
+inline void AMGPreconditioner<T>::build()
+{
+	m_levels.clear();
+	m_levels.pushBack(Level{});
+	while (m_levels.size() < m_maxLevels)
+	{
+		size_t l = m_levels.size() - 1;
+		const CSRMatrix<T>& A = matrix(l);
+		if (A.rows() <= m_maxCoarseSize)
+			break;
+		Array<size_t> aggregates;
+		size_t aggregateCount = aggregate(A, aggregates);
+		// stagnating coarsening
+		if (aggregateCount == 0 || aggregateCount * 10 > A.rows() * 9)
+			break;
+		m_levels[l].P = smoothedProlongator(A, aggregates, aggregateCount);
+		m_levels[l].R = transpose(m_levels[l].P, aggregateCount);
+		Level coarse;
+		coarse.A = multiply(m_levels[l].R, multiply(A, m_levels[l].P, aggregateCount), aggregateCount);
+		m_levels.pushBack(std::move(coarse));
+	}
+	setupLevels();
+}
+
+template<typename T>
+inline void AMGPreconditioner<T>::computeGalerkinOperators()
+{
+	for (size_t l = 1; l < m_levels.size(); l++)
+		m_levels[l].A = multiply(m_levels[l - 1].R, multiply(matrix(l - 1), m_levels[l - 1].P, rows(l)), rows(l));
+	setupLevels();
+}
+
+template<typename T>
+inline void AMGPreconditioner<T>::setupLevels()
+{
+	for (size_t l = 0; l < m_levels.size(); l++)
+	{
+		const CSRMatrix<T>& A = matrix(l);
+		Level& level = m_levels[l];
+		level.invDiagonal.resize(A.rows());
+		for (size_t i = 0; i < A.rows(); i++)
+		{
+			T diag = A.getValue(i, i);
+			level.invDiagonal[i] = diag != T{} ? T{ 1 } / diag : T{};
+		}
+		level.residual.resize(A.rows());
+		if (l + 1 < m_levels.size())
+		{
+			level.coarseRhs.resize(level.R.rows());
+			level.coarseCorrection.resize(level.R.rows());
+		}
+	}
+	factorizeCoarsest();
+}
+
+template<typename T>
+inline size_t AMGPreconditioner<T>::aggregate(const CSRMatrix<T>& A, Array<size_t>& aggregates) const
+{
+	const size_t n = A.rows();
+	// strength of connection |a_ij| >= theta * sqrt(|a_ii * a_jj|)
+	Array<T> diagonal(n);
+	for (size_t i = 0; i < n; i++)
+		diagonal[i] = std::abs(A.getValue(i, i));
+	Array<size_t> strongPtr(n + 1);
+	Array<size_t> strong;
+	strongPtr[0] = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		for (size_t k = A.rowBegin(i); k < A.rowEnd(i); k++)
+		{
+			size_t j = A.col(k);
+			if (j != i && std::abs(A.value(k)) >= m_strengthThreshold * std::sqrt(diagonal[i] * diagonal[j])
+				&& A.value(k) != T{})
+				strong.pushBack(j);
+		}
+		strongPtr[i + 1] = strong.size();
+	}
+	aggregates = Array<size_t>(n, NO_AGGREGATE);
+	size_t aggregateCount = 0;
+	// pass 1 - root nodes with completely free strong neighbourhood
+	for (size_t i = 0; i < n; i++)
+	{
+		// isolated nodes (e.g. eliminated Dirichlet rows) are left to the smoother
+		if (strongPtr[i] == strongPtr[i + 1] || aggregates[i] != NO_AGGREGATE)
+			continue;
+		bool free = true;
+		for (size_t k = strongPtr[i]; k < strongPtr[i + 1] && free; k++)
+			free = aggregates[strong[k]] == NO_AGGREGATE;
+		if (!free)
+			continue;
+		aggregates[i] = aggregateCount;
+		for (size_t k = strongPtr[i]; k < strongPtr[i + 1]; k++)
+			aggregates[strong[k]] = aggregateCount;
+		aggregateCount++;
+	}
+	// pass 2 - attach remaining nodes to a neighbouring aggregate from pass 1
+	Array<size_t> firstPass(aggregates);
+	for (size_t i = 0; i < n; i++)
+	{
+		if (aggregates[i] != NO_AGGREGATE)
+			continue;
+		for (size_t k = strongPtr[i]; k < strongPtr[i + 1]; k++)
+			if (firstPass[strong[k]] != NO_AGGREGATE)
+			{
+				aggregates[i] = firstPass[strong[k]];
+				break;
+			}
+	}
+	// pass 3 - leftovers form aggregates with their free neighbours
+	for (size_t i = 0; i < n; i++)
+	{
+		if (strongPtr[i] == strongPtr[i + 1] || aggregates[i] != NO_AGGREGATE)
+			continue;
+		aggregates[i] = aggregateCount;
+		for (size_t k = strongPtr[i]; k < strongPtr[i + 1]; k++)
+			if (aggregates[strong[k]] == NO_AGGREGATE)
+				aggregates[strong[k]] = aggregateCount;
+		aggregateCount++;
+	}
+	return aggregateCount;
+}
+
+template<typename T>
+inline CSRMatrix<T> AMGPreconditioner<T>::smoothedProlongator(const CSRMatrix<T>& A,
+	const Array<size_t>& aggregates, size_t aggregateCount) const
+{
+	const size_t n = A.rows();
+	// tentative prolongator - piecewise constant near null space with orthonormal columns
+	Array<size_t> aggregateSizes(aggregateCount, 0);
+	for (size_t i = 0; i < n; i++)
+		if (aggregates[i] != NO_AGGREGATE)
+			aggregateSizes[aggregates[i]]++;
+	Array<T> tentative(n, T{});
+	for (size_t i = 0; i < n; i++)
+		if (aggregates[i] != NO_AGGREGATE)
+			tentative[i] = T{ 1 } / std::sqrt(static_cast<T>(aggregateSizes[aggregates[i]]));
+	// P = (I - omega * D^-1 * A) * P_tent, omega = 4 / 3 / rho(D^-1 * A)
+	const T omega = T{ 4 } / (T{ 3 } * spectralRadiusEstimate(A));
+	Array<size_t> marker(aggregateCount, NO_AGGREGATE);
+	Array<T> accumulator(aggregateCount, T{});
+	Array<size_t> rowPtr(n + 1);
+	Array<size_t> colIdx;
+	Array<T> values;
+	rowPtr[0] = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		size_t rowStart = colIdx.size();
+		T diag = A.getValue(i, i);
+		auto add = [&](size_t col, T val)
+			{
+				if (marker[col] != i)
+				{
+					marker[col] = i;
+					accumulator[col] = T{};
+					colIdx.pushBack(col);
+				}
+				accumulator[col] += val;
+			};
+		if (aggregates[i] != NO_AGGREGATE)
+			add(aggregates[i], tentative[i]);
+		for (size_t k = A.rowBegin(i); k < A.rowEnd(i); k++)
+		{
+			size_t j = A.col(k);
+			if (aggregates[j] != NO_AGGREGATE && A.value(k) != T{})
+				add(aggregates[j], -omega * A.value(k) / diag * tentative[j]);
+		}
+		std::sort(colIdx.begin() + rowStart, colIdx.end());
+		for (size_t k = rowStart; k < colIdx.size(); k++)
+			values.pushBack(accumulator[colIdx[k]]);
+		rowPtr[i + 1] = colIdx.size();
+	}
+	return CSRMatrix<T>(std::move(rowPtr), std::move(colIdx), std::move(values));
+}
+
+template<typename T>
+inline T AMGPreconditioner<T>::spectralRadiusEstimate(const CSRMatrix<T>& A) const
+{
+	// power iteration on D^-1 * A from a deterministic start vector
+	const size_t n = A.rows();
+	Vector<T> x(n);
+	Vector<T> y(n);
+	for (size_t i = 0; i < n; i++)
+		x[i] = T{ 1 } + static_cast<T>(i % 7) / T{ 7 };
+	x /= norm(x);
+	T rho{};
+	for (int it = 0; it < 15; it++)
+	{
+		A.apply(x, y);
+		for (size_t i = 0; i < n; i++)
+			y[i] /= A.getValue(i, i);
+		rho = norm(y);
+		if (rho == T{})
+			return T{ 1 };
+		x = y / rho;
+	}
+	// power iteration underestimates, stay on the safe side
+	return T{ 1.1 } * rho;
+}
+
+template<typename T>
+inline void AMGPreconditioner<T>::factorizeCoarsest()
+{
+	const CSRMatrix<T>& A = matrix(m_levels.size() - 1);
+	const size_t n = A.rows();
+	// stagnating coarsening or the level limit can leave a large coarsest level,
+	// a dense factor would take n^2 memory and n^3 work, it is smoothed instead
+	if (n > m_maxCoarseSize)
+	{
+		m_coarseFactor = Array<T>();
+		return;
+	}
+	m_coarseFactor = Array<T>(n * n, T{});
+	for (size_t i = 0; i < n; i++)
+		for (size_t k = A.rowBegin(i); k < A.rowEnd(i); k++)
+			m_coarseFactor[i * n + A.col(k)] = A.value(k);
+	// in-place dense Cholesky of the lower triangle
+	for (size_t j = 0; j < n; j++)
+	{
+		T diag = m_coarseFactor[j * n + j];
+		for (size_t k = 0; k < j; k++)
+			diag -= m_coarseFactor[j * n + k] * m_coarseFactor[j * n + k];
+		assert(diag > T{} && "coarsest AMG operator is not positive definite");
+		diag = std::sqrt(diag);
+		m_coarseFactor[j * n + j] = diag;
+		for (size_t i = j + 1; i < n; i++)
+		{
+			T sum = m_coarseFactor[i * n + j];
+			for (size_t k = 0; k < j; k++)
+				sum -= m_coarseFactor[i * n + k] * m_coarseFactor[j * n + k];
+			m_coarseFactor[i * n + j] = sum / diag;
+		}
+	}
+}
+
+template<typename T>
+inline void AMGPreconditioner<T>::solveCoarsest(const Vector<T>& b, Vector<T>& x) const
+{
+	const size_t n = b.dim();
+	for (size_t i = 0; i < n; i++)
+	{
+		T sum = b[i];
+		for (size_t k = 0; k < i; k++)
+			sum -= m_coarseFactor[i * n + k] * x[k];
+		x[i] = sum / m_coarseFactor[i * n + i];
+	}
+	for (size_t i = n; i-- > 0;)
+	{
+		T sum = x[i];
+		for (size_t k = i + 1; k < n; k++)
+			sum -= m_coarseFactor[k * n + i] * x[k];
+		x[i] = sum / m_coarseFactor[i * n + i];
+	}
+}
+
+template<typename T>
+inline void AMGPreconditioner<T>::vCycle(size_t level, const Vector<T>& b, Vector<T>& x) const
+{
+	if (level + 1 == m_levels.size() && !m_coarseFactor.empty())
+	{
+		solveCoarsest(b, x);
+		return;
+	}
+	for (size_t i = 0; i < x.dim(); i++)
+		x[i] = T{};
+	if (level + 1 == m_levels.size())
+	{
+		// symmetric sweeps keep the preconditioner symmetric for CG
+		for (int s = 0; s < COARSE_SMOOTHING_SWEEPS; s++)
+		{
+			gaussSeidel(level, b, x, true);
+			gaussSeidel(level, b, x, false);
+		}
+		return;
+	}
+	const Level& current = m_levels[level];
+	const CSRMatrix<T>& A = matrix(level);
+	for (int s = 0; s < m_smoothingSweeps; s++)
+		gaussSeidel(level, b, x, true);
+	// coarse grid correction
+	A.apply(x, current.residual);
+	for (size_t i = 0; i < b.dim(); i++)
+		current.residual[i] = b[i] - current.residual[i];
+	current.R.apply(current.residual, current.coarseRhs);
+	vCycle(level + 1, current.coarseRhs, current.coarseCorrection);
+	current.P.apply(current.coarseCorrection, current.residual);
+	x += current.residual;
+	for (int s = 0; s < m_smoothingSweeps; s++)
+		gaussSeidel(level, b, x, false);
+}
+
+template<typename T>
+inline void AMGPreconditioner<T>::gaussSeidel(size_t level, const Vector<T>& b, Vector<T>& x, bool forward) const
+{
+	const CSRMatrix<T>& A = matrix(level);
+	const Array<T>& invDiagonal = m_levels[level].invDiagonal;
+	const size_t n = A.rows();
+	for (size_t idx = 0; idx < n; idx++)
+	{
+		size_t i = forward ? idx : n - 1 - idx;
+		T sum = b[i];
+		for (size_t k = A.rowBegin(i); k < A.rowEnd(i); k++)
+			if (A.col(k) != i)
+				sum -= A.value(k) * x[A.col(k)];
+		x[i] = sum * invDiagonal[i];
+	}
+}
+}
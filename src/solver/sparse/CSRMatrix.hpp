@@ -0,0 +1,437 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <utility>
+#include "data_structures/Array.hpp"
+#include "data_structures/StaticArray.hpp"
+#include "Matrix.hpp"
+#include "Vector.hpp"
+#include "solver/Mesh.hpp"
+#include "tools/ThreadPool.hpp"
+#include "solver/MaterialManager.hpp"
+#include "math/Matrix.hpp"
+
+namespace sparse
+{
+// compressed sparse row matrix - values and column indices of all rows
+// are stored contiguously, row i occupies [rowPtr[i], rowPtr[i + 1])
+// assembly is split into a symbolic phase (buildPattern) computing the sparsity
+// pattern from mesh connectivity and a numeric phase (assemble) scattering
+// element contributions into precomputed slots
+template<typename T>
+class CSRMatrix
+{
+private:
+	Array<size_t> m_rowPtr;
+	Array<size_t> m_colIdx;
+	Array<T> m_values;
+	Array<size_t> m_elementSlots; // value index of every (i, j) entry of every element matrix
+public:
+	CSRMatrix() = default;
+	explicit CSRMatrix(const Matrix<T>& matrix); // conversion from row-list form
+	CSRMatrix(Array<size_t>&& rowPtr, Array<size_t>&& colIdx, Array<T>&& values); // columns sorted in rows
+	CSRMatrix(const CSRMatrix& other);
+	CSRMatrix(CSRMatrix&& other) noexcept;
+	~CSRMatrix() = default;
+	CSRMatrix& operator=(const CSRMatrix& other);
+	CSRMatrix& operator=(CSRMatrix&& other) noexcept;
+	template<int N_NODES>
+	void buildPattern(const Mesh<T, N_NODES>& mesh);
+	template<int N_NODES>
+	void assemble(const Mesh<T, N_NODES>& mesh, const MaterialManager<T>& materialManager,
+		Vector<T>& rhs, const std::function<T(const Point&)>& sourceTerm);
+	size_t rows() const;
+	size_t nonZeros() const;
+	size_t rowBegin(size_t row) const;
+	size_t rowEnd(size_t row) const;
+	size_t col(size_t k) const;
+	const T& value(size_t k) const;
+	T& value(size_t k);
+	T getValue(size_t row, size_t col) const;
+	// eliminate fixed DOFs in a single pass over the nonzeros: couplings to fixed columns
+	// are moved to the rhs and fixed rows/columns are replaced by identity
+	void applyDirichlet(const Array<bool>& isFixed, const Vector<T>& fixedValues, Vector<T>& rhs);
+	void apply(const Vector<T>& x, Vector<T>& y) const; // y = A * x
+	void print() const;
+};
+
+template<typename T>
+inline CSRMatrix<T>::CSRMatrix(const Matrix<T>& matrix)
+{
+	size_t rowCount = matrix.rows();
+	size_t nnz = 0;
+	for (size_t i = 0; i < rowCount; i++)
+		nnz += matrix[i].dim();
+	m_rowPtr.resize(rowCount + 1);
+	m_colIdx.reserve(nnz);
+	m_values.reserve(nnz);
+	m_rowPtr[0] = 0;
+	for (size_t i = 0; i < rowCount; i++)
+	{
+		// row elements are kept sorted by column
+		for (const auto& elem : matrix[i])
+		{
+			m_colIdx.pushBack(elem.col());
+			m_values.pushBack(elem.val());
+		}
+		m_rowPtr[i + 1] = m_colIdx.size();
+	}
+}
+
+template<typename T>
+inline CSRMatrix<T>::CSRMatrix(Array<size_t>&& rowPtr, Array<size_t>&& colIdx, Array<T>&& values) :
+	m_rowPtr(std::move(rowPtr)), m_colIdx(std::move(colIdx)), m_values(std::move(values))
+{
+	assert(m_colIdx.size() == m_values.size());
+}
+
+template<typename T>
+inline CSRMatrix<T>::CSRMatrix(const CSRMatrix& other) :
+	m_rowPtr(other.m_rowPtr), m_colIdx(other.m_colIdx), m_values(other.m_values),
+	m_elementSlots(other.m_elementSlots) {}
+
+template<typename T>
+inline CSRMatrix<T>::CSRMatrix(CSRMatrix&& other) noexcept :
+	m_rowPtr(std::move(other.m_rowPtr)), m_colIdx(std::move(other.m_colIdx)), m_values(std::move(other.m_values)),
+	m_elementSlots(std::move(other.m_elementSlots)) {}
+
+template<typename T>
+inline CSRMatrix<T>& CSRMatrix<T>::operator=(const CSRMatrix& other)
+{
+	if (this != &other)
+	{
+		m_rowPtr = other.m_rowPtr;
+		m_colIdx = other.m_colIdx;
+		m_values = other.m_values;
+		m_elementSlots = other.m_elementSlots;
+	}
+	return *this;
+}
+
+template<typename T>
+inline CSRMatrix<T>& CSRMatrix<T>::operator=(CSRMatrix&& other) noexcept
+{
+	if (this != &other)
+	{
+		m_rowPtr = std::move(other.m_rowPtr);
+		m_colIdx = std::move(other.m_colIdx);
+		m_values = std::move(other.m_values);
+		m_elementSlots = std::move(other.m_elementSlots);
+	}
+	return *this;
+}
+
+template<typename T>
+template<int N_NODES>
+inline void CSRMatrix<T>::buildPattern(const Mesh<T, N_NODES>& mesh)
+{
+	const size_t nodeCount = mesh.nodeCount();
+	const size_t elementCount = mesh.elementCount();
+	// node -> element incidence (counting sort over element nodes)
+	Array<size_t> incidencePtr(nodeCount + 1, 0);
+	for (const auto& elem : mesh)
+		for (int a = 0; a < N_NODES; a++)
+			incidencePtr[elem.nodeIdx(a) + 1]++;
+	for (size_t i = 0; i < nodeCount; i++)
+		incidencePtr[i + 1] += incidencePtr[i];
+	Array<size_t> incidence(incidencePtr[nodeCount]);
+	Array<size_t> fill(incidencePtr);
+	for (size_t e = 0; e < elementCount; e++)
+		for (int a = 0; a < N_NODES; a++)
+			incidence[fill[mesh.element(e).nodeIdx(a)]++] = e;
+	// row i couples node i with every node of its incident elements
+	Array<size_t> marker(nodeCount, std::numeric_limits<size_t>::max());
+	m_rowPtr.resize(nodeCount + 1);
+	m_colIdx.clear();
+	m_colIdx.reserve(7 * nodeCount);
+	m_rowPtr[0] = 0;
+	for (size_t i = 0; i < nodeCount; i++)
+	{
+		for (size_t k = incidencePtr[i]; k < incidencePtr[i + 1]; k++)
+		{
+			const auto& elem = mesh.element(incidence[k]);
+			for (int a = 0; a < N_NODES; a++)
+			{
+				size_t j = elem.nodeIdx(a);
+				if (marker[j] != i)
+				{
+					marker[j] = i;
+					m_colIdx.pushBack(j);
+				}
+			}
+		}
+		std::sort(m_colIdx.begin() + m_rowPtr[i], m_colIdx.end());
+		m_rowPtr[i + 1] = m_colIdx.size();
+	}
+	m_values = Array<T>(m_colIdx.size(), T{});
+	// slots of element matrix entries (searched once here, never in numeric phase)
+	m_elementSlots.resize(elementCount * N_NODES * N_NODES);
+	for (size_t e = 0; e < elementCount; e++)
+	{
+		const auto& elem = mesh.element(e);
+		for (int a = 0; a < N_NODES; a++)
+		{
+			size_t row = elem.nodeIdx(a);
+			const size_t* rowBegin = m_colIdx.data() + m_rowPtr[row];
+			const size_t* rowEnd = m_colIdx.data() + m_rowPtr[row + 1];
+			for (int b = 0; b < N_NODES; b++)
+			{
+				const size_t* slot = std::lower_bound(rowBegin, rowEnd, elem.nodeIdx(b));
+				assert(slot != rowEnd && *slot == elem.nodeIdx(b));
+				m_elementSlots[(e * N_NODES + a) * N_NODES + b] = static_cast<size_t>(slot - m_colIdx.data());
+			}
+		}
+	}
+}
+
+template<typename T>
+template<int N_NODES>
+inline void CSRMatrix<T>::assemble(const Mesh<T, N_NODES>& mesh,
+	const MaterialManager<T>& materialManager,
+	Vector<T>& rhs, const std::function<T(const Point&)>& sourceTerm)
+{
+	assert(m_elementSlots.size() == mesh.elementCount() * N_NODES * N_NODES && "buildPattern must be called first");
+	size_t nodeCount = mesh.nodeCount();
+	rhs = Vector<T>(nodeCount);
+	for (auto& val : m_values)
+		val = T{};
+	const auto& refElement = mesh.referenceElement();
+	const auto& geometry = mesh.geometry();
+	using Geometry = ElementGeometry<T, N_NODES>;
+	constexpr size_t BATCH = Geometry::BATCH;
+	// elements of one color share no node, so they write disjoint rows and rhs entries
+	for (size_t color = 0; color < mesh.colorCount(); color++)
+	{
+		const size_t colorBegin = mesh.colorBegin(color);
+		ThreadPool::instance().parallelFor(mesh.colorEnd(color) - colorBegin, [&](size_t begin, size_t end)
+			{
+				StaticArray<T, N_NODES * N_NODES> elementMatrix;
+				StaticArray<T, N_NODES> nodalSource;
+				StaticArray<T, N_NODES> elementRhs;
+				T coeffs[BATCH];
+				typename Geometry::BatchMetrics metrics;
+				for (size_t first = colorBegin + begin; first < colorBegin + end; first += BATCH)
+				{
+					const size_t count = std::min(BATCH, colorBegin + end - first);
+					// diffusion coefficients, lanes past the chunk are computed but not used
+					for (size_t l = 0; l < BATCH; l++)
+						coeffs[l] = l < count ? materialManager.getMaterial(mesh.element(mesh.coloredElement(first + l)).materialIdx()).diffusionCoeff : T{ 1 };
+					geometry.metrics(first, coeffs, metrics);
+					for (size_t l = 0; l < count; l++)
+					{
+						const size_t e = mesh.coloredElement(first + l);
+						const auto& elem = mesh.element(e);
+						const size_t* slots = m_elementSlots.data() + e * N_NODES * N_NODES;
+						refElement.stiffnessMatrix({ metrics.c00[l], metrics.c01[l], metrics.c11[l] }, elementMatrix);
+						// source term interpolated from its nodal values
+						for (int i = 0; i < N_NODES; i++)
+							nodalSource[i] = sourceTerm(mesh.node(elem.nodeIdx(i)).position());
+						refElement.loadVector(metrics.absDetJ[l], nodalSource, elementRhs);
+						for (int i = 0; i < N_NODES; i++)
+						{
+							for (int j = 0; j < N_NODES; j++)
+								m_values[slots[i * N_NODES + j]] += elementMatrix[i * N_NODES + j];
+							rhs[elem.nodeIdx(i)] += elementRhs[i];
+						}
+					}
+				}
+			}, ThreadPool::DEFAULT_CHUNK_SIZE / 16);
+	}
+}
+
+template<typename T>
+inline size_t CSRMatrix<T>::rows() const
+{
+	return m_rowPtr.empty() ? 0 : m_rowPtr.size() - 1;
+}
+
+template<typename T>
+inline size_t CSRMatrix<T>::nonZeros() const
+{
+	return m_values.size();
+}
+
+template<typename T>
+inline size_t CSRMatrix<T>::rowBegin(size_t row) const
+{
+	return m_rowPtr[row];
+}
+
+template<typename T>
+inline size_t CSRMatrix<T>::rowEnd(size_t row) const
+{
+	return m_rowPtr[row + 1];
+}
+
+template<typename T>
+inline size_t CSRMatrix<T>::col(size_t k) const
+{
+	return m_colIdx[k];
+}
+
+template<typename T>
+inline const T& CSRMatrix<T>::value(size_t k) const
+{
+	return m_values[k];
+}
+
+template<typename T>
+inline T& CSRMatrix<T>::value(size_t k)
+{
+	return m_values[k];
+}
+
+template<typename T>
+inline T CSRMatrix<T>::getValue(size_t row, size_t col) const
+{
+	// binary search in sorted column indices of the row
+	size_t low = m_rowPtr[row];
+	size_t high = m_rowPtr[row + 1];
+	while (low < high)
+	{
+		size_t mid = low + (high - low) / 2;
+		if (m_colIdx[mid] < col)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	if (low < m_rowPtr[row + 1] && m_colIdx[low] == col)
+		return m_values[low];
+	return T{};
+}
+
+template<typename T>
+inline void CSRMatrix<T>::applyDirichlet(const Array<bool>& isFixed, const Vector<T>& fixedValues, Vector<T>& rhs)
+{
+	// explicit zeros are kept so that the pattern stays valid for reassembly
+	for (size_t i = 0; i < rows(); i++)
+	{
+		if (isFixed[i])
+		{
+			for (size_t k = m_rowPtr[i]; k < m_rowPtr[i + 1]; k++)
+				m_values[k] = m_colIdx[k] == i ? T{ 1 } : T{};
+			rhs[i] = fixedValues[i];
+			continue;
+		}
+		for (size_t k = m_rowPtr[i]; k < m_rowPtr[i + 1]; k++)
+		{
+			size_t j = m_colIdx[k];
+			if (isFixed[j])
+			{
+				// F_i = F_i - K_ij * g_j
+				rhs[i] -= m_values[k] * fixedValues[j];
+				m_values[k] = T{};
+			}
+		}
+	}
+}
+
+template<typename T>
+inline void CSRMatrix<T>::apply(const Vector<T>& x, Vector<T>& y) const
+{
+	size_t rowCount = rows();
+	if (y.dim() != rowCount)
+		y.resize(rowCount);
+	const size_t* rowPtr = m_rowPtr.data();
+	const size_t* colIdx = m_colIdx.data();
+	const T* values = m_values.data();
+	// rows are independent, so the result does not depend on the partitioning
+	ThreadPool::instance().parallelFor(rowCount, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				T sum{};
+				for (size_t k = rowPtr[i]; k < rowPtr[i + 1]; k++)
+					sum += values[k] * x[colIdx[k]];
+				y[i] = sum;
+			}
+		}, ThreadPool::DEFAULT_CHUNK_SIZE / 8);
+}
+
+template<typename T>
+inline void CSRMatrix<T>::print() const
+{
+	for (size_t i = 0; i < rows(); i++)
+	{
+		std::cout << "Row " << i << ":\n";
+		for (size_t k = m_rowPtr[i]; k < m_rowPtr[i + 1]; k++)
+			std::cout << "(" << m_values[k] << ", " << m_colIdx[k] << ") ";
+		std::cout << "\n";
+	}
+}
+
+// non-member
+template <typename T>
+Vector<T> operator*(const CSRMatrix<T>& A, const Vector<T>& v)
+{
+	Vector<T> result(A.rows());
+	A.apply(v, result);
+	return result;
+}
+
+// A^T, columns count taken as number of rows of the result
+template <typename T>
+CSRMatrix<T> transpose(const CSRMatrix<T>& A, size_t cols)
+{
+	Array<size_t> rowPtr(cols + 1, 0);
+	for (size_t k = 0; k < A.nonZeros(); k++)
+		rowPtr[A.col(k) + 1]++;
+	for (size_t i = 0; i < cols; i++)
+		rowPtr[i + 1] += rowPtr[i];
+	Array<size_t> colIdx(A.nonZeros());
+	Array<T> values(A.nonZeros());
+	Array<size_t> fill(rowPtr);
+	// rows visited in increasing order keep the columns of the result sorted
+	for (size_t i = 0; i < A.rows(); i++)
+		for (size_t k = A.rowBegin(i); k < A.rowEnd(i); k++)
+		{
+			size_t dst = fill[A.col(k)]++;
+			colIdx[dst] = i;
+			values[dst] = A.value(k);
+		}
+	return CSRMatrix<T>(std::move(rowPtr), std::move(colIdx), std::move(values));
+}
+
+// sparse product A * B (row by row with dense accumulator)
+template <typename T>
+CSRMatrix<T> multiply(const CSRMatrix<T>& A, const CSRMatrix<T>& B, size_t bCols)
+{
+	const size_t unmarked = std::numeric_limits<size_t>::max();
+	Array<size_t> marker(bCols, unmarked);
+	Array<T> accumulator(bCols, T{});
+	Array<size_t> rowPtr(A.rows() + 1);
+	Array<size_t> colIdx;
+	Array<T> values;
+	rowPtr[0] = 0;
+	for (size_t i = 0; i < A.rows(); i++)
+	{
+		size_t rowStart = colIdx.size();
+		for (size_t ka = A.rowBegin(i); ka < A.rowEnd(i); ka++)
+		{
+			const T& a = A.value(ka);
+			if (a == T{})
+				continue;
+			size_t j = A.col(ka);
+			for (size_t kb = B.rowBegin(j); kb < B.rowEnd(j); kb++)
+			{
+				size_t col = B.col(kb);
+				if (marker[col] != i)
+				{
+					marker[col] = i;
+					accumulator[col] = T{};
+					colIdx.pushBack(col);
+				}
+				accumulator[col] += a * B.value(kb);
+			}
+		}
+		std::sort(colIdx.begin() + rowStart, colIdx.end());
+		for (size_t k = rowStart; k < colIdx.size(); k++)
+			values.pushBack(accumulator[colIdx[k]]);
+		rowPtr[i + 1] = colIdx.size();
+	}
+	return CSRMatrix<T>(std::move(rowPtr), std::move(colIdx), std::move(values));
+}
+}
\ No newline at end of file
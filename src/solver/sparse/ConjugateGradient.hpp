@@ -0,0 +1,115 @@
+#pragma once
+#include <cmath>
+#include "Preconditioner.hpp"
+#include "Vector.hpp"
+
+namespace sparse
+{
+// preconditioned conjugate gradient for symmetric positive definite systems
+// Operator is any type providing rows() and apply(x, y) computing y = A * x
+template<typename T>
+class ConjugateGradient
+{
+private:
+	size_t m_maxIterations;
+	T m_relTolerance; // relative to the rhs norm
+	T m_absTolerance;
+	size_t m_iterations = 0;
+	T m_residualNorm = T{};
+	// workspace kept between solves, reallocated only when the size changes
+	Vector<T> m_r; // residual
+	Vector<T> m_z; // preconditioned residual
+	Vector<T> m_p; // search direction
+	Vector<T> m_Ap;
+public:
+	ConjugateGradient(size_t maxIterations = 10000, T relTolerance = T{ 1e-9 }, T absTolerance = T{ 1e-12 });
+	template<typename Operator>
+	bool solve(const Operator& A, const Vector<T>& b, Vector<T>& x, const Preconditioner<T>& M);
+	void setMaxIterations(size_t maxIterations);
+	void setTolerance(T relTolerance, T absTolerance);
+	size_t maxIterations() const;
+	size_t iterations() const;
+	T residualNorm() const;
+};
+
+template<typename T>
+inline ConjugateGradient<T>::ConjugateGradient(size_t maxIterations, T relTolerance, T absTolerance) :
+	m_maxIterations(maxIterations), m_relTolerance(relTolerance), m_absTolerance(absTolerance) {}
+
+template<typename T>
+template<typename Operator>
+inline bool ConjugateGradient<T>::solve(const Operator& A, const Vector<T>& b, Vector<T>& x, const Preconditioner<T>& M)
+{
+	const size_t n = A.rows();
+	if (x.dim() != n)
+		x.resize(n);
+	if (m_r.dim() != n)
+	{
+		m_r.resize(n);
+		m_z.resize(n);
+		m_p.resize(n);
+		m_Ap.resize(n);
+	}
+	m_iterations = 0;
+	// residual r = b - A * x
+	A.apply(x, m_r);
+	xpay(b, T{ -1 }, m_r);
+	m_residualNorm = norm(m_r);
+	const T tolerance = m_absTolerance + m_relTolerance * norm(b);
+	if (m_residualNorm <= tolerance)
+		return true;
+	M.apply(m_r, m_z);
+	m_p = m_z;
+	T rz = dot(m_r, m_z);
+	for (size_t k = 0; k < m_maxIterations; k++)
+	{
+		A.apply(m_p, m_Ap);
+		// step size
+		T alpha = rz / dot(m_p, m_Ap);
+		// x += alpha * p and r -= alpha * Ap with |r|^2 in a single sweep
+		m_residualNorm = std::sqrt(axpy2NormSq(alpha, m_p, x, -alpha, m_Ap, m_r));
+		m_iterations = k + 1;
+		if (m_residualNorm <= tolerance)
+			return true;
+		M.apply(m_r, m_z);
+		T rzNew = dot(m_r, m_z);
+		// improvement factor
+		T beta = rzNew / rz;
+		rz = rzNew;
+		// p = z + beta * p
+		xpay(m_z, beta, m_p);
+	}
+	return false;
+}
+
+template<typename T>
+inline void ConjugateGradient<T>::setMaxIterations(size_t maxIterations)
+{
+	m_maxIterations = maxIterations;
+}
+
+template<typename T>
+inline void ConjugateGradient<T>::setTolerance(T relTolerance, T absTolerance)
+{
+	m_relTolerance = relTolerance;
+	m_absTolerance = absTolerance;
+}
+
+template<typename T>
+inline size_t ConjugateGradient<T>::maxIterations() const
+{
+	return m_maxIterations;
+}
+
+template<typename T>
+inline size_t ConjugateGradient<T>::iterations() const
+{
+	return m_iterations;
+}
+
+template<typename T>
+inline T ConjugateGradient<T>::residualNorm() const
+{
+	return m_residualNorm;
+}
+}
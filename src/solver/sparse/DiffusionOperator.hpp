@@ -0,0 +1,217 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#include "data_structures/Array.hpp"
+#include "data_structures/StaticArray.hpp"
+#include "Vector.hpp"
+#include "solver/Mesh.hpp"
+#include "solver/MaterialManager.hpp"
+#include "tools/ThreadPool.hpp"
+
+namespace sparse
+{
+// matrix-free diffusion stiffness operator y = A * x for ConjugateGradient
+// nothing of the global matrix is stored, only the metric (coeff * |det J| * JinvT^T * JinvT,
+// 3 values) of every element, node indices and color ranges are read from the mesh
+// element matrices are recomputed on the fly from the constexpr reference integrals,
+// elements of one color are processed in batches with the element as the inner loop
+template<typename T, int N_NODES>
+class DiffusionOperator
+{
+private:
+	using Geometry = ElementGeometry<T, N_NODES>;
+	static constexpr size_t BATCH = Geometry::BATCH;
+	const Mesh<T, N_NODES>* m_mesh = nullptr; // must outlive the operator
+	const Geometry* m_geometry = nullptr;
+	size_t m_rows = 0;
+	// by element position in the geometry, padded by one batch like the geometry streams
+	Array<T> m_c00;
+	Array<T> m_c01;
+	Array<T> m_c11;
+	Array<bool> m_isFixed;
+	Vector<T> m_diagonal;
+public:
+	DiffusionOperator() = default;
+	~DiffusionOperator() = default;
+	DiffusionOperator(const DiffusionOperator&) = delete;
+	DiffusionOperator(DiffusionOperator&&) = delete;
+	DiffusionOperator& operator=(const DiffusionOperator&) = delete;
+	DiffusionOperator& operator=(DiffusionOperator&&) = delete;
+	// caches the element metrics and computes the load vector
+	void assemble(const Mesh<T, N_NODES>& mesh, const MaterialManager<T>& materialManager,
+		Vector<T>& rhs, const std::function<T(const Point&)>& sourceTerm);
+	// fixed rows and columns act as identity, couplings to fixed DOFs are moved to the rhs
+	void applyDirichlet(const Array<bool>& isFixed, const Vector<T>& fixedValues, Vector<T>& rhs);
+	size_t rows() const;
+	const Vector<T>& diagonal() const;
+	void apply(const Vector<T>& x, Vector<T>& y) const; // y = A * x
+private:
+	void applyBatch(size_t first, size_t count, const Vector<T>& x, Vector<T>& y) const;
+};
+
+template<typename T, int N_NODES>
+inline void DiffusionOperator<T, N_NODES>::assemble(const Mesh<T, N_NODES>& mesh,
+	const MaterialManager<T>& materialManager,
+	Vector<T>& rhs, const std::function<T(const Point&)>& sourceTerm)
+{
+	m_mesh = &mesh;
+	m_geometry = &mesh.geometry();
+	m_rows = mesh.nodeCount();
+	const size_t padded = mesh.elementCount() + BATCH;
+	m_c00 = Array<T>(padded, T{});
+	m_c01 = Array<T>(padded, T{});
+	m_c11 = Array<T>(padded, T{});
+	m_isFixed = Array<bool>(m_rows, false);
+	rhs = Vector<T>(m_rows);
+	m_diagonal = Vector<T>(m_rows);
+	const auto& refElement = mesh.referenceElement();
+	using Reference = ReferenceElement<T, N_NODES>;
+	for (size_t color = 0; color < mesh.colorCount(); color++)
+	{
+		const size_t colorBegin = mesh.colorBegin(color);
+		ThreadPool::instance().parallelFor(mesh.colorEnd(color) - colorBegin, [&](size_t begin, size_t end)
+			{
+				StaticArray<T, N_NODES> nodalSource;
+				StaticArray<T, N_NODES> elementRhs;
+				T coeffs[BATCH];
+				typename Geometry::BatchMetrics metrics;
+				for (size_t first = colorBegin + begin; first < colorBegin + end; first += BATCH)
+				{
+					const size_t count = std::min(BATCH, colorBegin + end - first);
+					for (size_t l = 0; l < BATCH; l++)
+						coeffs[l] = l < count ? materialManager.getMaterial(mesh.element(mesh.coloredElement(first + l)).materialIdx()).diffusionCoeff : T{ 1 };
+					m_geometry->metrics(first, coeffs, metrics);
+					for (size_t l = 0; l < count; l++)
+					{
+						const size_t k = first + l;
+						const auto& elem = mesh.element(mesh.coloredElement(k));
+						m_c00[k] = metrics.c00[l];
+						m_c01[k] = metrics.c01[l];
+						m_c11[k] = metrics.c11[l];
+						for (int i = 0; i < N_NODES; i++)
+							nodalSource[i] = sourceTerm(mesh.node(elem.nodeIdx(i)).position());
+						refElement.loadVector(metrics.absDetJ[l], nodalSource, elementRhs);
+						for (int i = 0; i < N_NODES; i++)
+						{
+							rhs[elem.nodeIdx(i)] += elementRhs[i];
+							m_diagonal[elem.nodeIdx(i)] += m_c00[k] * Reference::gradientIntegral(i, i, 0, 0)
+								+ 2 * m_c01[k] * Reference::gradientIntegral(i, i, 0, 1) + m_c11[k] * Reference::gradientIntegral(i, i, 1, 1);
+						}
+					}
+				}
+			}, ThreadPool::DEFAULT_CHUNK_SIZE / 16);
+	}
+}
+
+template<typename T, int N_NODES>
+inline void DiffusionOperator<T, N_NODES>::applyDirichlet(const Array<bool>& isFixed, const Vector<T>& fixedValues, Vector<T>& rhs)
+{
+	// F_i = F_i - sum_j K_ij * g_j over fixed j, with the operator still unconstrained
+	Vector<T> g(m_rows);
+	for (size_t i = 0; i < m_rows; i++)
+		if (isFixed[i])
+			g[i] = fixedValues[i];
+	Vector<T> Kg(m_rows);
+	apply(g, Kg);
+	for (size_t i = 0; i < m_rows; i++)
+	{
+		if (isFixed[i])
+		{
+			rhs[i] = fixedValues[i];
+			m_diagonal[i] = T{ 1 };
+		}
+		else
+		{
+			rhs[i] -= Kg[i];
+		}
+	}
+	m_isFixed = isFixed;
+}
+
+template<typename T, int N_NODES>
+inline size_t DiffusionOperator<T, N_NODES>::rows() const
+{
+	return m_rows;
+}
+
+template<typename T, int N_NODES>
+inline const Vector<T>& DiffusionOperator<T, N_NODES>::diagonal() const
+{
+	return m_diagonal;
+}
+
+template<typename T, int N_NODES>
+inline void DiffusionOperator<T, N_NODES>::apply(const Vector<T>& x, Vector<T>& y) const
+{
+	if (y.dim() != m_rows)
+		y.resize(m_rows);
+	ThreadPool& pool = ThreadPool::instance();
+	pool.parallelFor(m_rows, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+				y[i] = T{};
+		});
+	// a node gets at most one contribution per color, always in color order,
+	// so the result does not depend on the partitioning
+	for (size_t color = 0; color < m_mesh->colorCount(); color++)
+	{
+		const size_t colorBegin = m_mesh->colorBegin(color);
+		pool.parallelFor(m_mesh->colorEnd(color) - colorBegin, [&](size_t begin, size_t end)
+			{
+				for (size_t k = colorBegin + begin; k < colorBegin + end; k += BATCH)
+					applyBatch(k, std::min(BATCH, colorBegin + end - k), x, y);
+			}, ThreadPool::DEFAULT_CHUNK_SIZE / 16);
+	}
+	// identity on fixed DOFs
+	pool.parallelFor(m_rows, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+				if (m_isFixed[i])
+					y[i] = x[i];
+		});
+}
+
+template<typename T, int N_NODES>
+inline void DiffusionOperator<T, N_NODES>::applyBatch(size_t first, size_t count, const Vector<T>& x, Vector<T>& y) const
+{
+	using Reference = ReferenceElement<T, N_NODES>;
+	// gather, fixed DOFs are eliminated from the columns
+	T xe[N_NODES][BATCH];
+	for (int j = 0; j < N_NODES; j++)
+	{
+		const size_t* nodes = m_geometry->nodes(j) + first;
+		for (size_t l = 0; l < BATCH; l++)
+			xe[j][l] = m_isFixed[nodes[l]] ? T{} : x[nodes[l]];
+	}
+	// ye = (c00 * S00 + c01 * (S01 + S10) + c11 * S11) * xe, the reference integrals are
+	// compile time constants and the lanes are independent, so the lane loop vectorises
+	const T* c00 = m_c00.data() + first;
+	const T* c01 = m_c01.data() + first;
+	const T* c11 = m_c11.data() + first;
+	T ye[N_NODES][BATCH];
+	for (int i = 0; i < N_NODES; i++)
+	{
+		for (size_t l = 0; l < BATCH; l++)
+		{
+			T s00{};
+			T s01{};
+			T s11{};
+			for (int j = 0; j < N_NODES; j++)
+			{
+				s00 += Reference::gradientIntegral(i, j, 0, 0) * xe[j][l];
+				s01 += (Reference::gradientIntegral(i, j, 0, 1) + Reference::gradientIntegral(i, j, 1, 0)) * xe[j][l];
+				s11 += Reference::gradientIntegral(i, j, 1, 1) * xe[j][l];
+			}
+			ye[i][l] = c00[l] * s00 + c01[l] * s01 + c11[l] * s11;
+		}
+	}
+	// scatter only the lanes holding elements of this color
+	for (int i = 0; i < N_NODES; i++)
+	{
+		const size_t* nodes = m_geometry->nodes(i) + first;
+		for (size_t l = 0; l < count; l++)
+			y[nodes[l]] += ye[i][l];
+	}
+}
+}
@@ -0,0 +1,127 @@
+#pragma once
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+#include "data_structures/Array.hpp"
+#include "CSRMatrix.hpp"
+#include "Preconditioner.hpp"
+#include "Vector.hpp"
+
+namespace sparse
+{
+// zero fill-in incomplete Cholesky factorization M = L * L^T
+// L keeps exactly the lower triangular sparsity pattern of A
+template<typename T>
+class IncompleteCholesky : public Preconditioner<T>
+{
+private:
+	// lower factor in CSR form, diagonal entry stored last in every row
+	Array<size_t> m_rowPtr;
+	Array<size_t> m_colIdx;
+	Array<T> m_values;
+	T m_shift = T{}; // relative diagonal shift used to avoid breakdown
+public:
+	explicit IncompleteCholesky(const CSRMatrix<T>& A);
+	void apply(const Vector<T>& r, Vector<T>& z) const override;
+	T shift() const;
+private:
+	bool factorize(const CSRMatrix<T>& A, T shift);
+};
+
+template<typename T>
+inline IncompleteCholesky<T>::IncompleteCholesky(const CSRMatrix<T>& A)
+{
+	// copy lower triangle of A
+	const size_t n = A.rows();
+	m_rowPtr.resize(n + 1);
+	m_rowPtr[0] = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		for (size_t k = A.rowBegin(i); k < A.rowEnd(i) && A.col(k) <= i; k++)
+			m_colIdx.pushBack(A.col(k));
+		assert(!m_colIdx.empty() && m_colIdx.back() == i && "incomplete Cholesky requires stored diagonal");
+		m_rowPtr[i + 1] = m_colIdx.size();
+	}
+	m_values.resize(m_colIdx.size());
+	// Manteuffel shift A + shift * diag(A) if factorization breaks down
+	T shift{};
+	while (!factorize(A, shift))
+		shift = std::max(T{ 2 } * shift, T{ 1e-3 });
+	m_shift = shift;
+}
+
+template<typename T>
+inline bool IncompleteCholesky<T>::factorize(const CSRMatrix<T>& A, T shift)
+{
+	const size_t n = A.rows();
+	for (size_t i = 0; i < n; i++)
+	{
+		size_t k = m_rowPtr[i];
+		for (size_t a = A.rowBegin(i); a < A.rowEnd(i) && A.col(a) <= i; a++, k++)
+			m_values[k] = A.value(a);
+		m_values[m_rowPtr[i + 1] - 1] *= T{ 1 } + shift;
+	}
+	for (size_t i = 0; i < n; i++)
+	{
+		const size_t diagIdx = m_rowPtr[i + 1] - 1;
+		for (size_t k = m_rowPtr[i]; k < diagIdx; k++)
+		{
+			// L_ij = (a_ij - sum_m<j L_im * L_jm) / L_jj, sum over common pattern of rows i and j
+			const size_t j = m_colIdx[k];
+			const size_t jDiagIdx = m_rowPtr[j + 1] - 1;
+			T sum = m_values[k];
+			size_t p = m_rowPtr[i];
+			size_t q = m_rowPtr[j];
+			while (p < k && q < jDiagIdx)
+			{
+				if (m_colIdx[p] < m_colIdx[q])
+					p++;
+				else if (m_colIdx[p] > m_colIdx[q])
+					q++;
+				else
+					sum -= m_values[p++] * m_values[q++];
+			}
+			m_values[k] = sum / m_values[jDiagIdx];
+		}
+		// L_ii = sqrt(a_ii - sum_m<i L_im^2)
+		T diag = m_values[diagIdx];
+		for (size_t k = m_rowPtr[i]; k < diagIdx; k++)
+			diag -= m_values[k] * m_values[k];
+		if (!(diag > T{}))
+			return false;
+		m_values[diagIdx] = std::sqrt(diag);
+	}
+	return true;
+}
+
+template<typename T>
+inline void IncompleteCholesky<T>::apply(const Vector<T>& r, Vector<T>& z) const
+{
+	const size_t n = m_rowPtr.size() - 1;
+	if (z.dim() != n)
+		z.resize(n);
+	// forward substitution L y = r
+	for (size_t i = 0; i < n; i++)
+	{
+		const size_t diagIdx = m_rowPtr[i + 1] - 1;
+		T sum = r[i];
+		for (size_t k = m_rowPtr[i]; k < diagIdx; k++)
+			sum -= m_values[k] * z[m_colIdx[k]];
+		z[i] = sum / m_values[diagIdx];
+	}
+	// backward substitution L^T z = y (column oriented over rows of L)
+	for (size_t i = n; i-- > 0;)
+	{
+		const size_t diagIdx = m_rowPtr[i + 1] - 1;
+		z[i] /= m_values[diagIdx];
+		for (size_t k = m_rowPtr[i]; k < diagIdx; k++)
+			z[m_colIdx[k]] -= m_values[k] * z[i];
+	}
+}
+
+template<typename T>
+inline T IncompleteCholesky<T>::shift() const
+{
+	return m_shift;
+}
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <cassert>
+#include "data_structures/Array.hpp"
+#include "CSRMatrix.hpp"
+#include "Preconditioner.hpp"
+#include "Vector.hpp"
+#include "tools/ThreadPool.hpp"
+
+namespace sparse
+{
+// diagonal scaling M = diag(A)
+template<typename T>
+class JacobiPreconditioner : public Preconditioner<T>
+{
+private:
+	Array<T> m_invDiagonal;
+public:
+	explicit JacobiPreconditioner(const CSRMatrix<T>& A);
+	explicit JacobiPreconditioner(const Vector<T>& diagonal); // for operators without a stored matrix
+	void apply(const Vector<T>& r, Vector<T>& z) const override;
+};
+
+template<typename T>
+inline JacobiPreconditioner<T>::JacobiPreconditioner(const CSRMatrix<T>& A) : m_invDiagonal(A.rows())
+{
+	for (size_t i = 0; i < A.rows(); i++)
+	{
+		T diag = A.getValue(i, i);
+		assert(diag != T{} && "Jacobi preconditioner requires nonzero diagonal");
+		m_invDiagonal[i] = T{ 1 } / diag;
+	}
+}
+
+template<typename T>
+inline JacobiPreconditioner<T>::JacobiPreconditioner(const Vector<T>& diagonal) : m_invDiagonal(diagonal.dim())
+{
+	for (size_t i = 0; i < diagonal.dim(); i++)
+	{
+		assert(diagonal[i] != T{} && "Jacobi preconditioner requires nonzero diagonal");
+		m_invDiagonal[i] = T{ 1 } / diagonal[i];
+	}
+}
+
+template<typename T>
+inline void JacobiPreconditioner<T>::apply(const Vector<T>& r, Vector<T>& z) const
+{
+	if (z.dim() != r.dim())
+		z.resize(r.dim());
+	ThreadPool::instance().parallelFor(r.dim(), [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+				z[i] = m_invDiagonal[i] * r[i];
+		});
+}
+}
@@ -9,7 +9,7 @@
 #include "solver/MaterialManager.hpp"
 #include "solver/BoundaryConditionManager.hpp"
 #include "math/Matrix.hpp"
-#include "math/Polynomial.hpp"
+#include "math/StaticPolynomial.hpp"
 
 namespace sparse
 {
@@ -86,19 +86,23 @@ inline void Matrix<T>::assemble(const Mesh<T, N_NODES>& mesh,
 	const auto& refElement = mesh.referenceElement();
 	const auto& shapeFunctions = refElement.shapeFunctions();
 	const auto& refGradients = refElement.gradients();
+	using ShapeFunction = typename ReferenceElement<T, N_NODES>::ShapeFunction;
 	for (const auto& elem : mesh)
 	{
 		const auto& mapping = refElement.mapping(elem, mesh);
 		// transform gradients
-		StaticArray<::Vector<Polynomial<Polynomial<T>>, 2>, N_NODES> gradients;
+		StaticArray<::Vector<ShapeFunction, 2>, N_NODES> gradients;
 		for (int i = 0; i < N_NODES; i++)
 		{
-			gradients[i] = mapping.JinvT * refGradients[i];
+			::Vector<ShapeFunction, 2> refGradient;
+			refGradient[0] = refGradients[i][0];
+			refGradient[1] = refGradients[i][1];
+			gradients[i] = mapping.JinvT * refGradient;
 		}
 		// diffusion coefficient
 		T diffCoeff = materialManager.getMaterial(elem.materialIdx()).diffusionCoeff;
 		// source term interpolation plynomial
-		Polynomial<Polynomial<T>> sourcePolynomial;
+		ShapeFunction sourcePolynomial;
 		for (int i = 0; i < N_NODES; i++)
 			sourcePolynomial += shapeFunctions[i] * sourceTerm(mesh.node(elem.nodeIdx(i)).position());
 
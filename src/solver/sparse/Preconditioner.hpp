@@ -0,0 +1,29 @@
+#pragma once
+#include "Vector.hpp"
+
+namespace sparse
+{
+// interface of preconditioners accepted by ConjugateGradient
+// apply computes z = M^-1 * r for a symmetric positive definite approximation M of A
+template<typename T>
+class Preconditioner
+{
+public:
+	virtual ~Preconditioner() = default;
+	virtual void apply(const Vector<T>& r, Vector<T>& z) const = 0;
+};
+
+// M = I (plain conjugate gradient)
+template<typename T>
+class IdentityPreconditioner : public Preconditioner<T>
+{
+public:
+	void apply(const Vector<T>& r, Vector<T>& z) const override;
+};
+
+template<typename T>
+inline void IdentityPreconditioner<T>::apply(const Vector<T>& r, Vector<T>& z) const
+{
+	z = r; // copies in place when z already has the right dimension
+}
+}
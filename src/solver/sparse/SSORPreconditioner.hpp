@@ -0,0 +1,66 @@
+#pragma once
+#include <cassert>
+#include "data_structures/Array.hpp"
+#include "CSRMatrix.hpp"
+#include "Preconditioner.hpp"
+#include "Vector.hpp"
+
+namespace sparse
+{
+// symmetric successive over-relaxation
+// M = w / (2 - w) * (D / w + L) * (D / w)^-1 * (D / w + U), 0 < w < 2
+template<typename T>
+class SSORPreconditioner : public Preconditioner<T>
+{
+private:
+	const CSRMatrix<T>& m_matrix; // must outlive the preconditioner
+	Array<size_t> m_diagonalIdx; // value index of diagonal entry of every row
+	T m_omega;
+public:
+	explicit SSORPreconditioner(const CSRMatrix<T>& A, T omega = T{ 1 });
+	void apply(const Vector<T>& r, Vector<T>& z) const override;
+};
+
+template<typename T>
+inline SSORPreconditioner<T>::SSORPreconditioner(const CSRMatrix<T>& A, T omega) :
+	m_matrix(A), m_diagonalIdx(A.rows()), m_omega(omega)
+{
+	assert(omega > T{} && omega < T{ 2 });
+	for (size_t i = 0; i < A.rows(); i++)
+	{
+		size_t k = A.rowBegin(i);
+		while (k < A.rowEnd(i) && A.col(k) < i)
+			k++;
+		assert(k < A.rowEnd(i) && A.col(k) == i && "SSOR preconditioner requires stored diagonal");
+		m_diagonalIdx[i] = k;
+	}
+}
+
+template<typename T>
+inline void SSORPreconditioner<T>::apply(const Vector<T>& r, Vector<T>& z) const
+{
+	const size_t n = m_matrix.rows();
+	if (z.dim() != n)
+		z.resize(n);
+	// forward sweep (D / w + L) y = r, y stored in z
+	for (size_t i = 0; i < n; i++)
+	{
+		T sum = r[i];
+		for (size_t k = m_matrix.rowBegin(i); k < m_diagonalIdx[i]; k++)
+			sum -= m_matrix.value(k) * z[m_matrix.col(k)];
+		z[i] = sum * m_omega / m_matrix.value(m_diagonalIdx[i]);
+	}
+	// scaling by D / w
+	for (size_t i = 0; i < n; i++)
+		z[i] *= m_matrix.value(m_diagonalIdx[i]) / m_omega;
+	// backward sweep (D / w + U) z = y
+	for (size_t i = n; i-- > 0;)
+	{
+		T sum = z[i];
+		for (size_t k = m_diagonalIdx[i] + 1; k < m_matrix.rowEnd(i); k++)
+			sum -= m_matrix.value(k) * z[m_matrix.col(k)];
+		z[i] = sum * m_omega / m_matrix.value(m_diagonalIdx[i]);
+	}
+	z *= (T{ 2 } - m_omega) / m_omega;
+}
+}
@@ -1,6 +1,7 @@
 #pragma once
 #include <cmath>
 #include "data_structures/Array.hpp"
+#include "tools/ThreadPool.hpp"
 
 namespace sparse
 {
@@ -49,7 +50,14 @@ inline Vector<T>& Vector<T>::operator=(const Vector<T>& other)
 {
 	if(this != &other)
 	{
-		m_components = other.m_components;
+		// reuse the storage when the dimensions agree
+		if (m_components.size() == other.m_components.size())
+		{
+			for (size_t i = 0; i < m_components.size(); i++)
+				m_components[i] = other.m_components[i];
+		}
+		else
+			m_components = other.m_components;
 	}
 	return *this;
 }
@@ -91,39 +99,43 @@ inline void Vector<T>::resize(size_t n)
 template<typename T>
 Vector<T>& Vector<T>::operator+=(const Vector<T>& other)
 {
-	for (size_t i = 0; i < m_components.size(); i++)
-	{
-		m_components[i] += other.m_components[i];
-	}
+	ThreadPool::instance().parallelFor(m_components.size(), [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+				m_components[i] += other.m_components[i];
+		});
 	return *this;
 }
 
 template<typename T>
 Vector<T>& Vector<T>::operator-=(const Vector<T>& other)
 {
-	for (size_t i = 0; i < m_components.size(); i++)
-	{
-		m_components[i] -= other.m_components[i];
-	}
+	ThreadPool::instance().parallelFor(m_components.size(), [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+				m_components[i] -= other.m_components[i];
+		});
 	return *this;
 }
 
 template<typename T>
 Vector<T>& Vector<T>::operator*=(const T& t)
 {
-	for (size_t i = 0; i < m_components.size(); i++)
-	{
-		m_components[i] *= t;
-	}
+	ThreadPool::instance().parallelFor(m_components.size(), [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+				m_components[i] *= t;
+		});
 	return *this;
 }
 template<typename T>
 Vector<T>& Vector<T>::operator/=(const T& t)
 {
-	for (size_t i = 0; i < m_components.size(); i++)
-	{
-		m_components[i] /= t;
-	}
+	ThreadPool::instance().parallelFor(m_components.size(), [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+				m_components[i] /= t;
+		});
 	return *this;
 }
 
@@ -176,12 +188,13 @@ Vector<T> operator/(const Vector<T>& v, const T& t)
 template<typename T>
 T operator*(const Vector<T>& u, const Vector<T>& v)
 {
-	T result{};
-	for (size_t i = 0; i < u.dim(); i++)
-	{
-		result += u[i] * v[i];
-	}
-	return result;
+	return ThreadPool::instance().parallelReduce<T>(u.dim(), [&](size_t begin, size_t end)
+		{
+			T sum{};
+			for (size_t i = begin; i < end; i++)
+				sum += u[i] * v[i];
+			return sum;
+		});
 }
 
 template<typename T>
@@ -201,4 +214,61 @@ T norm(const Vector<T>& v)
 {
 	return std::sqrt(normSq(v));
 }
-}
\ No newline at end of file
+
+// in-place kernels, none of them allocates
+
+// y = a * x + y
+template<typename T>
+void axpy(const T& a, const Vector<T>& x, Vector<T>& y)
+{
+	ThreadPool::instance().parallelFor(y.dim(), [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+				y[i] += a * x[i];
+		});
+}
+
+// y = x + a * y
+template<typename T>
+void xpay(const Vector<T>& x, const T& a, Vector<T>& y)
+{
+	ThreadPool::instance().parallelFor(y.dim(), [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+				y[i] = x[i] + a * y[i];
+		});
+}
+
+// y = a * x + y, returns |y|^2 of the updated vector
+template<typename T>
+T axpyNormSq(const T& a, const Vector<T>& x, Vector<T>& y)
+{
+	return ThreadPool::instance().parallelReduce<T>(y.dim(), [&](size_t begin, size_t end)
+		{
+			T sum{};
+			for (size_t i = begin; i < end; i++)
+			{
+				y[i] += a * x[i];
+				sum += y[i] * y[i];
+			}
+			return sum;
+		});
+}
+
+// u = a * x + u and v = b * y + v in one sweep, returns |v|^2 of the updated v
+template<typename T>
+T axpy2NormSq(const T& a, const Vector<T>& x, Vector<T>& u, const T& b, const Vector<T>& y, Vector<T>& v)
+{
+	return ThreadPool::instance().parallelReduce<T>(v.dim(), [&](size_t begin, size_t end)
+		{
+			T sum{};
+			for (size_t i = begin; i < end; i++)
+			{
+				u[i] += a * x[i];
+				v[i] += b * y[i];
+				sum += v[i] * v[i];
+			}
+			return sum;
+		});
+}
+}
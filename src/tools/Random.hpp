@@ -15,16 +15,23 @@ public:
     // Static function interface
     template <typename T>
     static T get(T min, T max)
+    {
+        return get(min, max, getEngine());
+    }
+
+    // Draw from a caller owned stream
+    template <typename T>
+    static T get(T min, T max, std::mt19937& engine)
     {
         if constexpr (std::is_integral_v<T>)
         {
             std::uniform_int_distribution<T> distribution(min, max);
-            return distribution(getEngine());
+            return distribution(engine);
         }
         else if constexpr (std::is_floating_point_v<T>)
         {
             std::uniform_real_distribution<T> distribution(min, max);
-            return distribution(getEngine());
+            return distribution(engine);
         }
         else
         {
@@ -34,6 +41,13 @@ public:
         }
     }
 
+    // Independent stream seeded from this thread's engine, for work that must not
+    // depend on which thread executes it
+    static std::mt19937 stream()
+    {
+        return std::mt19937(getEngine()());
+    }
+
 private:
     // lazily seeded random number engine
     static std::mt19937& getEngine()
@@ -0,0 +1,197 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include "data_structures/Array.hpp"
+#include "data_structures/StaticArray.hpp"
+
+// fixed set of worker threads shared by the whole application
+// work is split into chunks that depend only on the problem size and the thread count,
+// so parallel reductions are bit-reproducible for a given thread count
+class ThreadPool
+{
+private:
+	Array<std::thread> m_workers;
+	std::mutex m_submitMutex; // one job at a time
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_done;
+	// current job
+	void (*m_invoke)(void*, size_t) = nullptr;
+	void* m_context = nullptr;
+	size_t m_taskCount = 0;
+	std::atomic<size_t> m_nextTask{ 0 };
+	size_t m_busyWorkers = 0;
+	size_t m_generation = 0;
+	bool m_stop = false;
+public:
+	static constexpr size_t DEFAULT_CHUNK_SIZE = 4096;
+	static constexpr size_t MAX_CHUNKS = 128;
+
+	explicit ThreadPool(size_t threadCount = std::thread::hardware_concurrency());
+	~ThreadPool();
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool(ThreadPool&&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+	ThreadPool& operator=(ThreadPool&&) = delete;
+
+	// lazily created pool using all hardware threads
+	static ThreadPool& instance();
+
+	size_t threadCount() const; // including the calling thread
+	size_t chunkCount(size_t count, size_t minChunkSize = DEFAULT_CHUNK_SIZE) const;
+
+	// function(task) for task in [0, taskCount), returns when all tasks are done
+	template<typename Function>
+	void run(size_t taskCount, Function&& function);
+	// function(begin, end) over contiguous chunks of [0, count)
+	template<typename Function>
+	void parallelFor(size_t count, Function&& function, size_t minChunkSize = DEFAULT_CHUNK_SIZE);
+	// sum of function(begin, end) over the chunks, accumulated in chunk order
+	template<typename T, typename Function>
+	T parallelReduce(size_t count, Function&& function, size_t minChunkSize = DEFAULT_CHUNK_SIZE);
+private:
+	void workerLoop();
+	void executeTasks();
+	static bool& insideJob();
+	template<typename Function>
+	static void invoke(void* context, size_t task);
+	static size_t chunkBegin(size_t count, size_t chunks, size_t chunk);
+};
+
+inline ThreadPool::ThreadPool(size_t threadCount)
+{
+	threadCount = std::max<size_t>(threadCount, 1);
+	m_workers.resize(threadCount - 1);
+	for (size_t i = 0; i < m_workers.size(); i++)
+		m_workers[i] = std::thread(&ThreadPool::workerLoop, this);
+}
+
+inline ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_wake.notify_all();
+	for (std::thread& worker : m_workers)
+		worker.join();
+}
+
+inline ThreadPool& ThreadPool::instance()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+inline size_t ThreadPool::threadCount() const
+{
+	return m_workers.size() + 1;
+}
+
+inline size_t ThreadPool::chunkCount(size_t count, size_t minChunkSize) const
+{
+	size_t chunks = (count + minChunkSize - 1) / std::max<size_t>(minChunkSize, 1);
+	return std::clamp<size_t>(chunks, 1, std::min(threadCount(), MAX_CHUNKS));
+}
+
+template<typename Function>
+inline void ThreadPool::run(size_t taskCount, Function&& function)
+{
+	// nested jobs run serially on the calling worker
+	if (taskCount <= 1 || m_workers.empty() || insideJob())
+	{
+		for (size_t task = 0; task < taskCount; task++)
+			function(task);
+		return;
+	}
+	std::lock_guard<std::mutex> submitLock(m_submitMutex);
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_invoke = &invoke<std::remove_reference_t<Function>>;
+		m_context = const_cast<void*>(static_cast<const void*>(&function));
+		m_taskCount = taskCount;
+		m_nextTask.store(0, std::memory_order_relaxed);
+		m_busyWorkers = m_workers.size();
+		m_generation++;
+	}
+	m_wake.notify_all();
+	// the calling thread works too
+	executeTasks();
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_done.wait(lock, [this] { return m_busyWorkers == 0; });
+}
+
+template<typename Function>
+inline void ThreadPool::parallelFor(size_t count, Function&& function, size_t minChunkSize)
+{
+	const size_t chunks = chunkCount(count, minChunkSize);
+	run(chunks, [&](size_t chunk)
+		{
+			function(chunkBegin(count, chunks, chunk), chunkBegin(count, chunks, chunk + 1));
+		});
+}
+
+template<typename T, typename Function>
+inline T ThreadPool::parallelReduce(size_t count, Function&& function, size_t minChunkSize)
+{
+	const size_t chunks = chunkCount(count, minChunkSize);
+	StaticArray<T, MAX_CHUNKS> partials;
+	run(chunks, [&](size_t chunk)
+		{
+			partials[chunk] = function(chunkBegin(count, chunks, chunk), chunkBegin(count, chunks, chunk + 1));
+		});
+	// fixed summation order
+	T result{};
+	for (size_t chunk = 0; chunk < chunks; chunk++)
+		result += partials[chunk];
+	return result;
+}
+
+inline void ThreadPool::workerLoop()
+{
+	size_t generation = 0;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wake.wait(lock, [&] { return m_stop || m_generation != generation; });
+			if (m_stop)
+				return;
+			generation = m_generation;
+		}
+		executeTasks();
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (--m_busyWorkers == 0)
+			m_done.notify_one();
+	}
+}
+
+inline void ThreadPool::executeTasks()
+{
+	bool& inside = insideJob();
+	inside = true;
+	for (size_t task = m_nextTask.fetch_add(1); task < m_taskCount; task = m_nextTask.fetch_add(1))
+		m_invoke(m_context, task);
+	inside = false;
+}
+
+inline bool& ThreadPool::insideJob()
+{
+	static thread_local bool inside = false;
+	return inside;
+}
+
+template<typename Function>
+inline void ThreadPool::invoke(void* context, size_t task)
+{
+	(*static_cast<Function*>(context))(task);
+}
+
+inline size_t ThreadPool::chunkBegin(size_t count, size_t chunks, size_t chunk)
+{
+	return count * chunk / chunks;
+}